@@ -0,0 +1,137 @@
+/*
+ * cache.c - The sizes of the CPU's caches, and a routine to evict them
+ *
+ * glibc answers sysconf(_SC_LEVELn_CACHE_SIZE) from CPUID on x86, but
+ * returns 0 elsewhere, so we fall back to the cache descriptions the
+ * kernel exports under /sys/devices/system/cpu/cpu0/cache.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache.h"
+
+#define CACHE_DEFAULT_BYTES (8 << 20) /* if nothing tells us the LLC size */
+#define CACHE_DEFAULT_LINE  64
+#define EVICT_FACTOR        2         /* the LLC needn't be strict LRU */
+
+#define SYSFS_CACHE "/sys/devices/system/cpu/cpu0/cache/index%d/%s"
+
+static size_t llc_bytes = 0;   /* cached results of the detection */
+static int line_bytes = 0;
+static char *evict_buf = NULL; /* the buffer cache_evict walks */
+
+/*
+ * read_sysfs - Read the first line of cache index file name into buf,
+ *     and return 0, or -1 if there is no such file
+ */
+static int read_sysfs(int index, char *name, char *buf, int len)
+{
+    char path[256];
+    FILE *fp;
+
+    sprintf(path, SYSFS_CACHE, index, name);
+    if ((fp = fopen(path, "r")) == NULL)
+	return -1;
+    if (fgets(buf, len, fp) == NULL) {
+	fclose(fp);
+	return -1;
+    }
+    buf[strcspn(buf, "\n")] = '\0';
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * scan_sysfs - Find the size of the highest-level data or unified
+ *     cache that the kernel describes, and its line size
+ */
+static void scan_sysfs(void)
+{
+    char buf[64], *end;
+    int index, level, best = 0;
+    long size;
+
+    /* e.g. index3: level "3", type "Unified", size "32768K" */
+    for (index = 0; read_sysfs(index, "level", buf, sizeof(buf)) == 0; 
+	 index++) {
+	level = atoi(buf);
+	if (level <= best || read_sysfs(index, "type", buf, sizeof(buf)) < 0 
+	    || strcmp(buf, "Instruction") == 0)
+	    continue;
+	if (read_sysfs(index, "size", buf, sizeof(buf)) < 0)
+	    continue;
+	size = strtol(buf, &end, 10);
+	if (*end == 'K')
+	    size <<= 10;
+	else if (*end == 'M')
+	    size <<= 20;
+	if (size <= 0)
+	    continue;
+	best = level;
+	llc_bytes = size;
+	if (read_sysfs(index, "coherency_line_size", buf, sizeof(buf)) == 0
+	    && atoi(buf) > 0)
+	    line_bytes = atoi(buf);
+    }
+}
+
+/*
+ * detect - Find the last-level cache and line sizes, trusting sysconf
+ *     over sysfs and sysfs over the defaults
+ */
+static void detect(void)
+{
+    long size = 0, line = 0;
+
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    if ((size = sysconf(_SC_LEVEL4_CACHE_SIZE)) <= 0 &&
+	(size = sysconf(_SC_LEVEL3_CACHE_SIZE)) <= 0)
+	size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    line = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+#endif
+    if (size <= 0 || line <= 0)
+	scan_sysfs();
+    if (size > 0)
+	llc_bytes = size;
+    if (line > 0)
+	line_bytes = line;
+    if (llc_bytes == 0)
+	llc_bytes = CACHE_DEFAULT_BYTES;
+    if (line_bytes == 0)
+	line_bytes = CACHE_DEFAULT_LINE;
+}
+
+size_t cache_llc_bytes(void)
+{
+    if (llc_bytes == 0)
+	detect();
+    return llc_bytes;
+}
+
+int cache_line_bytes(void)
+{
+    if (line_bytes == 0)
+	detect();
+    return line_bytes;
+}
+
+/*
+ * cache_evict - The buffer is allocated (and faulted in) on the first
+ *     call, so later calls only cost the memory traffic
+ */
+void cache_evict(void)
+{
+    size_t n = EVICT_FACTOR * cache_llc_bytes();
+    int line = cache_line_bytes();
+    volatile char *p, *end;
+
+    if (evict_buf == NULL && (evict_buf = (char *)calloc(n, 1)) == NULL) {
+	fprintf(stderr, "cache: can't allocate %lu bytes to evict the "
+		"caches\n", (unsigned long)n);
+	exit(1);
+    }
+    for (p = evict_buf, end = evict_buf + n; p < end; p += line)
+	*p += 1;
+}
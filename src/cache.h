@@ -0,0 +1,26 @@
+/*
+ * cache.h - The sizes of the CPU's caches, and a routine to evict them
+ *     between timed runs
+ */
+#ifndef __CACHE_H_
+#define __CACHE_H_
+
+#include <stddef.h>
+
+/* 
+ * Size in bytes of the last-level data cache, from sysconf or sysfs,
+ * or CACHE_DEFAULT_BYTES if neither knows it
+ */
+size_t cache_llc_bytes(void);
+
+/* Size in bytes of a cache line */
+int cache_line_bytes(void);
+
+/* 
+ * Write one word in every line of a buffer EVICT_FACTOR times the
+ * size of the last-level cache, which leaves (almost) nothing else in
+ * the caches and writes back whatever was dirty
+ */
+void cache_evict(void);
+
+#endif /* __CACHE_H_ */
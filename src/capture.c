@@ -0,0 +1,521 @@
+/*
+ * capture.c - An LD_PRELOAD library that records the allocator requests
+ *     of a real program as a malloc lab trace
+ *
+ *     MMCAPTURE=prog.rep LD_PRELOAD=./libcapture.so prog ...
+ *
+ * writes prog.rep when prog exits (a binary trace if the name ends in
+ * ".bin"; "%p" in the name is replaced by the process id). Without
+ * MMCAPTURE set, the library passes every request straight to libc.
+ *
+ * Every block gets a hidden CAP_HDR-byte header in front of it holding
+ * its trace id, so free and realloc find the id without a shared map.
+ * Each thread logs its requests into a buffer of its own, stamped with
+ * a global sequence number; the only shared write per request is the
+ * increment of that number. Full buffers are pushed onto a lock-free
+ * stack, and a flusher thread appends them to a raw log next to the
+ * trace. A thread takes its buffer out of its state while it logs a
+ * request, so the final flush can't push a buffer that is being
+ * written. At exit the raw log is sorted by sequence number and
+ * written out with tf_create, which fills in num_ids and num_ops last.
+ *
+ * Ids freed by a thread are reused by that thread's later allocations,
+ * so num_ids stays near the peak number of live blocks. Blocks that
+ * were allocated before capturing started (by other libraries'
+ * constructors, say) are left out of the trace, and so are the
+ * requests of forked children. Zero-byte requests are recorded as
+ * 1-byte ones, since mm_malloc(0) is undefined. Only glibc is supported:
+ * the real allocator is reached through its __libc_ entry points.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tracefile.h"
+
+#define CAP_HDR   16      /* bytes of hidden header before each block */
+#define CAP_RECS  16384   /* records in a per-thread log buffer */
+#define CAP_POLL  1000000 /* ns the flusher sleeps when there's no work */
+
+/* The real allocator */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t align, size_t size);
+extern void __libc_free(void *ptr);
+
+/* The hidden header, right before the block */
+typedef struct {
+    uint32_t offset;   /* bytes from the libc block to ours */
+    int32_t id;        /* trace id, -1 if the block isn't traced */
+    uint64_t size;     /* bytes requested */
+} cap_hdr_t;
+
+/* One logged request */
+typedef struct {
+    uint64_t seq;      /* global order of the request */
+    int32_t type;      /* ALLOC, REALLOC or FREE */
+    int32_t id;
+    int32_t size;
+    int32_t pad;
+} cap_rec_t;
+
+/* A thread's log buffer */
+typedef struct cap_buf {
+    struct cap_buf *next;      /* in the stack of full buffers */
+    int n;                     /* records used */
+    cap_rec_t recs[CAP_RECS];
+} cap_buf_t;
+
+/* Per-thread state, kept on a list for the final flush */
+typedef struct cap_thread {
+    struct cap_thread *next;
+    cap_buf_t *buf;            /* buffer being filled, NULL if none */
+    int *free_ids;             /* ids this thread freed, reused first */
+    int nfree, maxfree;
+} cap_thread_t;
+
+/* Global state */
+static volatile int capturing;        /* set while requests are logged */
+static char out_path[4096];           /* the trace to write */
+static char raw_path[4096 + 8];       /* the raw log */
+static int raw_fd = -1;
+static pid_t cap_pid;                 /* the process being captured */
+static uint64_t next_seq;             /* next sequence number */
+static int32_t next_id;               /* next id never handed out */
+static cap_buf_t *full_bufs;          /* lock-free stack of full buffers */
+static cap_thread_t *threads;         /* every thread that has logged */
+static int stopping;                  /* tells the flusher to finish */
+static pthread_t flusher;
+static pthread_key_t thread_key;
+static __thread cap_thread_t *self;   /* this thread's state */
+
+/*
+ * cap_push - Push a full buffer for the flusher
+ */
+static void cap_push(cap_buf_t *b)
+{
+    b->next = __atomic_load_n(&full_bufs, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&full_bufs, &b->next, b, 1,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	;
+}
+
+/*
+ * cap_thread_exit - Hand an exiting thread's partial buffer to the
+ *     flusher. At exit this runs on other threads' states too; a thread
+ *     in the middle of cap_log holds its buffer, so it isn't taken.
+ */
+static void cap_thread_exit(void *arg)
+{
+    cap_thread_t *t = (cap_thread_t *)arg;
+    cap_buf_t *b;
+
+    b = __atomic_exchange_n(&t->buf, NULL, __ATOMIC_ACQUIRE);
+    if (b != NULL && b->n > 0)
+	cap_push(b);
+    else if (b != NULL)
+	__libc_free(b);
+}
+
+/*
+ * cap_self - This thread's state, created on its first request
+ */
+static cap_thread_t *cap_self(void)
+{
+    cap_thread_t *t;
+
+    if (self != NULL)
+	return self;
+    if ((t = (cap_thread_t *)__libc_calloc(1, sizeof(cap_thread_t))) == NULL)
+	return NULL;
+    self = t;   /* before pthread_setspecific, which may allocate */
+    t->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&threads, &t->next, t, 1,
+					__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+	;
+    pthread_setspecific(thread_key, t);
+    return t;
+}
+
+/*
+ * cap_log - Log a request in this thread's buffer. The buffer is taken
+ *     out of t while it is written and put back after, so that it has
+ *     one owner at a time: this thread, or cap_finish if it got there
+ *     first, in which case the request starts a buffer that is lost.
+ */
+static void cap_log(cap_thread_t *t, int type, int id, size_t size)
+{
+    cap_rec_t *r;
+    cap_buf_t *b;
+
+    b = __atomic_exchange_n(&t->buf, NULL, __ATOMIC_ACQUIRE);
+    if (b == NULL) {
+	if ((b = (cap_buf_t *)__libc_malloc(sizeof(cap_buf_t))) == NULL)
+	    return;
+	b->n = 0;
+    }
+    r = &b->recs[b->n++];
+    r->seq = __atomic_fetch_add(&next_seq, 1, __ATOMIC_RELAXED);
+    r->type = type;
+    r->id = id;
+    r->size = (size == 0) ? 1 : (size > INT32_MAX) ? INT32_MAX : (int)size;
+    r->pad = 0;
+    if (b->n == CAP_RECS)
+	cap_push(b);
+    else
+	__atomic_store_n(&t->buf, b, __ATOMIC_RELEASE);
+}
+
+/*
+ * cap_new_id - An id for a new block: one this thread freed, or a
+ *     fresh one. Reusing only our own ids keeps each id's requests in
+ *     sequence order.
+ */
+static int cap_new_id(cap_thread_t *t)
+{
+    if (t->nfree > 0)
+	return t->free_ids[--t->nfree];
+    return __atomic_fetch_add(&next_id, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * cap_free_id - Remember that this thread freed id
+ */
+static void cap_free_id(cap_thread_t *t, int id)
+{
+    int *ids;
+
+    if (t->nfree == t->maxfree) {
+	ids = (int *)__libc_realloc(t->free_ids,
+				    (t->maxfree ? 2*t->maxfree : 256) * sizeof(int));
+	if (ids == NULL)
+	    return;   /* the id is just not reused */
+	t->free_ids = ids;
+	t->maxfree = t->maxfree ? 2*t->maxfree : 256;
+    }
+    t->free_ids[t->nfree++] = id;
+}
+
+/*
+ * cap_block - Set up the header of a block that libc returned at base
+ *     with our block offset bytes in, and log its allocation
+ */
+static void *cap_block(void *base, size_t offset, size_t size)
+{
+    char *p = (char *)base + offset;
+    cap_hdr_t *h = (cap_hdr_t *)p - 1;
+    cap_thread_t *t;
+
+    h->offset = offset;
+    h->size = size;
+    h->id = -1;
+    if (capturing && (t = cap_self()) != NULL) {
+	h->id = cap_new_id(t);
+	cap_log(t, ALLOC, h->id, size);
+    }
+    return p;
+}
+
+/*
+ * cap_flusher - Body of the flusher thread: append full buffers to the
+ *     raw log until told to stop and there are none left
+ */
+static void *cap_flusher(void *arg)
+{
+    cap_buf_t *b, *next;
+    struct timespec ts = {0, CAP_POLL};
+    char *p;
+    ssize_t n, left;
+    int stop;
+
+    for (;;) {
+	stop = __atomic_load_n(&stopping, __ATOMIC_ACQUIRE);
+	b = __atomic_exchange_n(&full_bufs, NULL, __ATOMIC_ACQUIRE);
+	if (b == NULL) {
+	    if (stop)
+		break;
+	    nanosleep(&ts, NULL);
+	    continue;
+	}
+	for (; b != NULL; b = next) {
+	    next = b->next;
+	    p = (char *)b->recs;
+	    for (left = b->n * sizeof(cap_rec_t); left > 0; left -= n, p += n)
+		if ((n = write(raw_fd, p, left)) <= 0) {
+		    perror("capture: write to the raw log failed");
+		    break;
+		}
+	    __libc_free(b);
+	}
+    }
+    return NULL;
+}
+
+/*
+ * cap_child - Don't capture in forked children; only the parent owns
+ *     the flusher and the logs
+ */
+static void cap_child(void)
+{
+    capturing = 0;
+}
+
+/*
+ * cap_cmp - qsort comparison of records by sequence number
+ */
+static int cap_cmp(const void *a, const void *b)
+{
+    uint64_t x = ((const cap_rec_t *)a)->seq, y = ((const cap_rec_t *)b)->seq;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * cap_init - Start capturing if MMCAPTURE names a trace to write
+ */
+__attribute__((constructor))
+static void cap_init(void)
+{
+    char *env = getenv("MMCAPTURE"), *pct;
+
+    if (env == NULL || *env == '\0')
+	return;
+    cap_pid = getpid();
+    if ((pct = strstr(env, "%p")) != NULL)
+	snprintf(out_path, sizeof(out_path), "%.*s%d%s", (int)(pct - env),
+		 env, (int)cap_pid, pct + 2);
+    else
+	snprintf(out_path, sizeof(out_path), "%s", env);
+    snprintf(raw_path, sizeof(raw_path), "%s.raw", out_path);
+    if ((raw_fd = open(raw_path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+	perror(raw_path);
+	return;
+    }
+    if (pthread_key_create(&thread_key, cap_thread_exit) != 0 ||
+	pthread_create(&flusher, NULL, cap_flusher, NULL) != 0) {
+	fprintf(stderr, "capture: can't start the flusher\n");
+	close(raw_fd);
+	unlink(raw_path);
+	return;
+    }
+    pthread_atfork(NULL, NULL, cap_child);
+    capturing = 1;
+}
+
+/*
+ * cap_finish - At exit, flush every buffer, then sort the raw log and
+ *     write the trace. A thread still allocating while the process
+ *     exits keeps the buffer it is writing, and those requests are
+ *     left out of the trace.
+ */
+__attribute__((destructor))
+static void cap_finish(void)
+{
+    cap_thread_t *t;
+    cap_rec_t *recs;
+    tfwriter_t *w;
+    struct stat st;
+    size_t n, i, len;
+    int *sizes = NULL, binary;
+    long long live = 0, peak = 0;
+
+    if (!capturing || getpid() != cap_pid)
+	return;
+    capturing = 0;
+    for (t = threads; t != NULL; t = t->next)
+	cap_thread_exit(t);
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(flusher, NULL);
+
+    if (fstat(raw_fd, &st) < 0) {
+	perror(raw_path);
+	return;
+    }
+    n = st.st_size / sizeof(cap_rec_t);
+    len = n * sizeof(cap_rec_t);
+    recs = (len > 0) ? mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			    raw_fd, 0) : NULL;
+    if (recs == MAP_FAILED) {
+	perror(raw_path);
+	return;
+    }
+    qsort(recs, n, sizeof(cap_rec_t), cap_cmp);
+
+    /* Keep track of the live bytes for the suggested heap size */
+    if (next_id > 0 && (sizes = (int *)calloc(next_id, sizeof(int))) == NULL) {
+	fprintf(stderr, "capture: out of memory\n");
+	return;
+    }
+    len = strlen(out_path);
+    binary = (len > 4 && strcmp(out_path + len - 4, ".bin") == 0);
+    if ((w = tf_create(out_path, binary)) == NULL)
+	return;
+    for (i = 0; i < n; i++) {
+	live += (recs[i].type == FREE ? 0 : recs[i].size) - sizes[recs[i].id];
+	sizes[recs[i].id] = (recs[i].type == FREE) ? 0 : recs[i].size;
+	if (live > peak)
+	    peak = live;
+	if (tf_put(w, recs[i].type, recs[i].id, recs[i].size) < 0)
+	    break;
+    }
+    if (tf_finish(w, peak > INT32_MAX ? INT32_MAX : (int)peak, 1) == 0) {
+	fprintf(stderr, "capture: %s: %d ids, %lu ops\n", out_path,
+		(int)next_id, (unsigned long)n);
+	unlink(raw_path);
+    }
+    if (recs != NULL)
+	munmap(recs, n * sizeof(cap_rec_t));
+    close(raw_fd);
+    free(sizes);
+}
+
+/*
+ * The allocator entry points glibc lets a library replace
+ */
+
+void *malloc(size_t size)
+{
+    void *base;
+
+    if (size > SIZE_MAX - CAP_HDR ||
+	(base = __libc_malloc(CAP_HDR + size)) == NULL)
+	return NULL;
+    return cap_block(base, CAP_HDR, size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    void *base;
+
+    if (size != 0 && n > (SIZE_MAX - CAP_HDR) / size) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if ((base = __libc_calloc(1, CAP_HDR + n * size)) == NULL)
+	return NULL;
+    return cap_block(base, CAP_HDR, n * size);
+}
+
+void free(void *ptr)
+{
+    cap_hdr_t *h;
+    cap_thread_t *t;
+
+    if (ptr == NULL)
+	return;
+    h = (cap_hdr_t *)ptr - 1;
+    if (h->id >= 0 && capturing && (t = cap_self()) != NULL) {
+	cap_log(t, FREE, h->id, 0);
+	cap_free_id(t, h->id);
+    }
+    __libc_free((char *)ptr - h->offset);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    cap_hdr_t *h;
+    cap_thread_t *t;
+    char *base;
+    size_t oldsize;
+    int id;
+
+    if (ptr == NULL)
+	return malloc(size);
+    if (size == 0) {
+	free(ptr);
+	return NULL;
+    }
+    if (size > SIZE_MAX - CAP_HDR)
+	return NULL;
+    h = (cap_hdr_t *)ptr - 1;
+    id = h->id;
+    oldsize = h->size;
+
+    /* An over-aligned block has to move to lose its larger offset */
+    if (h->offset == CAP_HDR) {
+	if ((base = __libc_realloc((char *)ptr - CAP_HDR, CAP_HDR + size))
+	    == NULL)
+	    return NULL;
+    }
+    else {
+	if ((base = __libc_malloc(CAP_HDR + size)) == NULL)
+	    return NULL;
+	memcpy(base + CAP_HDR, ptr, oldsize < size ? oldsize : size);
+	__libc_free((char *)ptr - h->offset);
+    }
+
+    h = (cap_hdr_t *)(base + CAP_HDR) - 1;
+    h->offset = CAP_HDR;
+    h->size = size;
+    h->id = id;
+    if (capturing && (t = cap_self()) != NULL) {
+	if (id < 0) {   /* traced from now on */
+	    h->id = cap_new_id(t);
+	    cap_log(t, ALLOC, h->id, size);
+	}
+	else
+	    cap_log(t, REALLOC, id, size);
+    }
+    return base + CAP_HDR;
+}
+
+void *memalign(size_t align, size_t size)
+{
+    void *base;
+
+    if (align <= CAP_HDR)
+	return malloc(size);
+    if ((align & (align - 1)) != 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+    /* The block starts align bytes in, leaving room for the header */
+    if (size > SIZE_MAX - align ||
+	(base = __libc_memalign(align, align + size)) == NULL)
+	return NULL;
+    return cap_block(base, align, size);
+}
+
+int posix_memalign(void **memptr, size_t align, size_t size)
+{
+    void *p;
+
+    if (align % sizeof(void *) != 0 || (align & (align - 1)) != 0)
+	return EINVAL;
+    if ((p = memalign(align, size)) == NULL)
+	return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+void *aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+void *valloc(size_t size)
+{
+    return memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    return (ptr == NULL) ? 0 : ((cap_hdr_t *)ptr - 1)->size;
+}
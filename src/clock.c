@@ -1,5 +1,5 @@
 /* 
- * clock.c - Routines for using the cycle counters on x86, 
+ * clock.c - Routines for using the cycle counters on x86, x86-64,
  *           Alpha, and Sparc boxes.
  * 
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
@@ -9,9 +9,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/times.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
 #include "clock.h"
 
+#define CALIBRATE_NS   10000000 /* length of each TSC calibration run */
+#define CALIBRATE_RUNS 5        /* runs, of which we take the median */
+
 
 /******************************************************* 
  * Machine dependent functions 
@@ -71,6 +78,26 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+#elif defined(__x86_64__)
+/*******************************************************
+ * x86-64 versions of start_counter() and get_counter(),
+ * which count TSC ticks (see tsc_begin and tsc_end below)
+ *******************************************************/
+
+static unsigned long long cyc_start = 0;
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    cyc_start = tsc_begin();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    return (double)(tsc_end() - cyc_start);
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -195,10 +222,18 @@ double mhz_full(int verbose, int sleeptime)
 }
 /* $end mhz */
 
-/* Version using a default sleeptime */
+/* 
+ * Version using a default sleeptime, except on x86-64, where the 
+ * counter is the TSC and tsc_mhz measures its rate in a fraction of
+ * the time
+ */
 double mhz(int verbose)
 {
+#if defined(__x86_64__)
+    return tsc_mhz(verbose);
+#else
     return mhz_full(verbose, 2);
+#endif
 }
 
 /** Special counters that compensate for timer interrupt overhead */
@@ -277,3 +312,176 @@ double get_comp_counter()
     return ctime;
 }
 
+/*******************************************************
+ * Timestamps for timing single operations. Unlike the
+ * counters above they need no start call, so they can 
+ * bracket every call into the malloc package.
+ *******************************************************/
+
+#if defined(__x86_64__)
+
+/* rdtscp waits for all earlier instructions before reading the TSC */
+unsigned long long read_tsc()
+{
+    unsigned hi, lo, aux;
+
+    asm volatile("rdtscp" : "=a" (lo), "=d" (hi), "=c" (aux));
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+#elif defined(__i386__)
+
+unsigned long long read_tsc()
+{
+    unsigned hi, lo;
+
+    access_counter(&hi, &lo);
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+#else
+
+/* No cycle counter here, so count nanoseconds instead */
+unsigned long long read_tsc()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif
+
+/*******************************************************
+ * The TSC as a timer. Where it is invariant, it ticks at 
+ * a constant rate whatever the core's clock and power 
+ * state, so TSC ticks divided by tsc_mhz are seconds.
+ *******************************************************/
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/* 
+ * Does the CPU have rdtscp and an invariant TSC (CPUID leaf
+ * 0x80000001 EDX bit 27, and leaf 0x80000007 EDX bit 8)?
+ */
+int tsc_invariant()
+{
+    unsigned a, b, c, d;
+
+    if (!__get_cpuid(0x80000001, &a, &b, &c, &d) || !(d & (1 << 27)))
+	return 0;
+    if (!__get_cpuid(0x80000007, &a, &b, &c, &d) || !(d & (1 << 8)))
+	return 0;
+    return 1;
+}
+
+/* 
+ * Start of a timed region: the lfence before rdtsc keeps earlier 
+ * instructions out of it, the one after keeps later ones from 
+ * starting before the TSC is read
+ */
+unsigned long long tsc_begin()
+{
+    unsigned hi, lo;
+
+    asm volatile("lfence; rdtsc; lfence" : "=a" (lo), "=d" (hi) :: "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/* 
+ * End of a timed region: rdtscp waits for the region to finish, and
+ * the lfence keeps later instructions from starting before it
+ */
+unsigned long long tsc_end()
+{
+    unsigned hi, lo, aux;
+
+    asm volatile("rdtscp; lfence" : "=a" (lo), "=d" (hi), "=c" (aux) 
+		 :: "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+#else
+
+int tsc_invariant()
+{
+    return 0;
+}
+
+unsigned long long tsc_begin()
+{
+    return read_tsc();
+}
+
+unsigned long long tsc_end()
+{
+    return read_tsc();
+}
+
+#endif
+
+/* Nanoseconds on CLOCK_MONOTONIC_RAW, which NTP doesn't slew */
+static unsigned long long raw_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* 
+ * Measure the TSC rate in MHz against CLOCK_MONOTONIC_RAW, spinning 
+ * (not sleeping) for CALIBRATE_NS so the core doesn't idle. The clock
+ * is read on both sides of each TSC read, and the median of
+ * CALIBRATE_RUNS runs is kept, so an interrupt in one run doesn't
+ * skew the rate. The rate is measured once and then cached.
+ */
+double tsc_mhz(int verbose)
+{
+    static double rate = 0;
+    double rates[CALIBRATE_RUNS];
+    unsigned long long ns0, ns1, c0, c1;
+    int i;
+
+    if (rate > 0)
+	return rate;
+    for (i = 0; i < CALIBRATE_RUNS; i++) {
+	ns0 = raw_ns();
+	c0 = tsc_begin();
+	ns0 = (ns0 + raw_ns()) / 2;
+	do {
+	    ns1 = raw_ns();
+	    c1 = tsc_end();
+	    ns1 = (ns1 + raw_ns()) / 2;
+	} while (ns1 - ns0 < CALIBRATE_NS);
+	rates[i] = (double)(c1 - c0) * 1e3 / (double)(ns1 - ns0);
+    }
+    qsort(rates, CALIBRATE_RUNS, sizeof(double), cmp_double);
+    rate = rates[CALIBRATE_RUNS / 2];
+    if (verbose)
+	printf("TSC rate ~= %.3f MHz (%s)\n", rate, 
+	       tsc_invariant() ? "invariant" : "not invariant");
+    return rate;
+}
+
+/* Smallest difference between two back-to-back read_tsc calls */
+unsigned long long tsc_ovhd()
+{
+    unsigned long long t0, t1, best = ~0ULL;
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+	t0 = read_tsc();
+	t1 = read_tsc();
+	if (t1 - t0 < best)
+	    best = t1 - t0;
+    }
+    return best;
+}
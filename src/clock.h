@@ -20,3 +20,23 @@ double mhz_full(int verbose, int sleeptime);
 void start_comp_counter();
 
 double get_comp_counter();
+
+/** Timestamps for timing single operations (rdtscp on x86-64) */
+
+/* Read the time stamp counter */
+unsigned long long read_tsc();
+
+/* Measure overhead for a pair of read_tsc calls */
+unsigned long long tsc_ovhd();
+
+/** The TSC as a high-resolution timer (x86 and x86-64) */
+
+/* Does the CPU have rdtscp and a constant-rate (invariant) TSC? */
+int tsc_invariant();
+
+/* Read the TSC at the start and at the end of a timed region */
+unsigned long long tsc_begin();
+unsigned long long tsc_end();
+
+/* TSC rate in MHz, calibrated against CLOCK_MONOTONIC_RAW */
+double tsc_mhz(int verbose);
@@ -62,11 +62,18 @@
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
+/* 
+ * Address space reserved for each growable block ('g' requests) 
+ */
+#define GROW_RESERVE (64*(1<<20))  /* 64 MB */
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_TSC    1   /* invariant TSC w/K-best scheme (x86 & x86-64), */
+                       /* falls back to gettimeofday on other CPUs */
 
 #endif /* __CONFIG_H */
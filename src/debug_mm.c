@@ -35,8 +35,8 @@
 #define PACK(size, alloc)  ((size) | (alloc))
 
 /* Read and write a word at address p */
-#define GET(p)     (*(size_t *)(p))
-#define PUT(p, val)  (*(size_t *)(p) = (val))
+#define GET(p)     (*(unsigned int *)(p))
+#define PUT(p, val)  (*(unsigned int *)(p) = (val))
 
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)  (GET(p) & ~0x7)
@@ -56,6 +56,14 @@
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
+/*
+ * Free-list links are heap offsets rather than pointers, so that they
+ * fit in a word on 64-bit systems too. NIL ends the list either way.
+ */
+#define NIL  ((unsigned int)-1)
+#define OFFSET(bp)  ((unsigned int)((char *)(bp) - (char *)mem_heap_lo()))
+#define ADDR(off)   ((char *)mem_heap_lo() + (off))
+
 //static unsigned int extend_cnt = 0;
 static char* freeptr = NULL;
 static char* allocptr;
@@ -315,34 +323,34 @@ static void add_node(char * brk)
 static void delete_node(char *brk)
 {
 //  node_cnt--;
-  if(*(size_t *)(brk) == (void *)-1)
+  if(GET(brk) == NIL)
   {
-    if(*(size_t *)(brk+WSIZE) == (void *)-1)
+    if(GET(brk+WSIZE) == NIL)
     {
       freeptr = NULL;
       return ;
     }
     else
     {
-      char * next_addr = *((size_t *)(brk+WSIZE));
-      PUT(next_addr, (void *)-1);      
+      char * next_addr = ADDR(GET(brk+WSIZE));
+      PUT(next_addr, NIL);      
     }
   }
   else
   {
   // neither the end of list nor the start of list
-      if(*(size_t *)(brk+WSIZE) == (void*)-1)
+      if(GET(brk+WSIZE) == NIL)
       {
       // if the end of list, namely freeptr         
-        freeptr = *(size_t *)(brk);
-	PUT(freeptr+WSIZE, (void*)-1);	
+        freeptr = ADDR(GET(brk));
+	PUT(freeptr+WSIZE, NIL);	
 	return ;
       }
-      char * next_addr = *((size_t *)(brk+WSIZE));
-      char * prev_addr = *(size_t *)brk;
+      char * next_addr = ADDR(GET(brk+WSIZE));
+      char * prev_addr = ADDR(GET(brk));
       
-      PUT((prev_addr+WSIZE), next_addr);
-      PUT(next_addr, prev_addr);
+      PUT((prev_addr+WSIZE), OFFSET(next_addr));
+      PUT(next_addr, OFFSET(prev_addr));
   }
 }
 
@@ -354,17 +362,17 @@ static void add_node(char *brk)
   {
     freeptr = brk;
     /* at the first time the prev is itself*/
-    PUT(brk, (void *)-1);
-    PUT(brk+WSIZE, (void *)-1);
+    PUT(brk, NIL);
+    PUT(brk+WSIZE, NIL);
     return ;
   }
 
   char * free_addr = freeptr; // which is also the old node
   char * new_node = brk;
 
-  PUT(brk, free_addr);
-  PUT(brk+WSIZE, (void*)-1);
-  PUT(freeptr+WSIZE, new_node);
+  PUT(brk, OFFSET(free_addr));
+  PUT(brk+WSIZE, NIL);
+  PUT(freeptr+WSIZE, OFFSET(new_node));
   freeptr = brk;
 }
 #endif
@@ -521,7 +529,7 @@ static char *extend_heap(size_t words)
 #if IMPLICIT_LIST == 1
   char *oldbrk;
   size_t newsize = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
-  if((int)(oldbrk = mem_sbrk(newsize)) == (void*)-1 )
+  if((oldbrk = mem_sbrk(newsize)) == (void*)-1 )
   {
     return NULL;
   }
@@ -535,7 +543,7 @@ static char *extend_heap(size_t words)
   char *oldbrk;
   size_t newsize = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
   newsize += DSIZE;
-  if((int)(oldbrk = mem_sbrk(newsize)) == (void*)-1 )
+  if((oldbrk = mem_sbrk(newsize)) == (void*)-1 )
   {
     return NULL;
   }
@@ -550,7 +558,7 @@ static char *extend_heap(size_t words)
   char *oldbrk;
   size_t newsize = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
   newsize += DSIZE;
-  if((int)(oldbrk = mem_sbrk(newsize)) == (void*)-1 )
+  if((oldbrk = mem_sbrk(newsize)) == (void*)-1 )
   {
     return NULL;
   }
@@ -583,9 +591,9 @@ static char *find_fit(size_t newsize)
         if(freeptr == NULL)
           return NULL;
 
-	for(brk = freeptr; *(size_t *)(brk) != (void*)-1; )
+	for(brk = freeptr; GET(brk) != NIL; )
 	{
-	  char * prev_ptr = *(size_t *)(brk);
+	  char * prev_ptr = ADDR(GET(brk));
 	  if(newsize < GET_SIZE(HDRP(brk)))
 	  {
 	     return brk;
@@ -943,7 +951,7 @@ void *mm_realloc(void *ptr, size_t size)
   newptr = mm_malloc(size);
   if (newptr == NULL)
     return NULL;
-  copySize = *(size_t *)((char *)oldptr - WSIZE);
+  copySize = GET_SIZE(HDRP(oldptr)) - DSIZE;
 //  printf("caculated copySize = %d, while size = %d\n", copySize, size);
   if (size < copySize)
     copySize = size;    
@@ -970,3 +978,16 @@ static int mm_check(void)
 }
 #endif
 
+
+#ifdef MM_PLUGIN
+/* The package as seen by mdriver -m, when built as debug_mm.so */
+const mm_plugin_t mm_plugin = {
+  "debug_mm.c", mm_init, mm_malloc, mm_free, mm_realloc, NULL, NULL,
+#if DEBUG == 1
+  mm_check,
+#else
+  NULL,
+#endif
+  NULL, NULL, NULL
+};
+#endif
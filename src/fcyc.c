@@ -127,12 +127,23 @@ static void clear()
  * fcyc - Use K-best scheme to estimate the running time of function f
  */
 double fcyc(test_funct f, void *argp)
+{
+    return fcyc_prep(f, NULL, argp);
+}
+
+/*
+ * fcyc_prep - Same as fcyc, but call prep(argp) (if not NULL) before 
+ *     each measurement, outside of the timed region
+ */
+double fcyc_prep(test_funct f, test_funct prep, void *argp)
 {
     double result;
     init_sampler();
     if (compensate) {
 	do {
 	    double cyc;
+	    if (prep)
+		prep(argp);
 	    if (clear_cache)
 		clear();
 	    start_comp_counter();
@@ -143,6 +154,8 @@ double fcyc(test_funct f, void *argp)
     } else {
 	do {
 	    double cyc;
+	    if (prep)
+		prep(argp);
 	    if (clear_cache)
 		clear();
 	    start_counter();
@@ -13,6 +13,9 @@ typedef void (*test_funct)(void *);
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Same as fcyc, but call prep(argp) untimed before each measurement */
+double fcyc_prep(test_funct f, test_funct prep, void* argp);
+
 /*********************************************************
  * Set the various parameters used by measurement routines 
  *********************************************************/
@@ -6,9 +6,11 @@
 #include "fcyc.h"
 #include "clock.h"
 #include "ftimer.h"
+#include "cache.h"
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
+static int tsc_ok;  /* USE_TSC: is the TSC invariant on this CPU? */
 
 extern int verbose; /* -v option in mdriver.c */
 
@@ -18,6 +20,7 @@ extern int verbose; /* -v option in mdriver.c */
 void init_fsecs(void)
 {
     Mhz = 0; /* keep gcc -Wall happy */
+    tsc_ok = 0;
 
 #if USE_FCYC
     if (verbose)
@@ -26,10 +29,33 @@ void init_fsecs(void)
     /* set key parameters for the fcyc package */
     set_fcyc_maxsamples(20); 
     set_fcyc_clear_cache(1);
+    set_fcyc_cache_size(cache_llc_bytes());
+    set_fcyc_cache_block(cache_line_bytes());
     set_fcyc_compensate(1);
     set_fcyc_epsilon(0.01);
     set_fcyc_k(3);
     Mhz = mhz(verbose > 0);
+#elif USE_TSC
+    /* 
+     * The TSC resolves the short traces that gettimeofday can't, but
+     * only counts time if its rate doesn't follow the core's clock
+     */
+    tsc_ok = tsc_invariant();
+    if (!tsc_ok) {
+	printf("No invariant TSC on this CPU; measuring performance "
+	       "with gettimeofday() instead.\n");
+	return;
+    }
+    if (verbose)
+	printf("Measuring performance with the TSC.\n");
+
+    /* Runs start on a warm cache, as with the other timers */
+    set_fcyc_maxsamples(20); 
+    set_fcyc_clear_cache(0);
+    set_fcyc_compensate(0);
+    set_fcyc_epsilon(0.01);
+    set_fcyc_k(3);
+    Mhz = tsc_mhz(verbose > 0);
 #elif USE_ITIMER
     if (verbose)
 	printf("Measuring performance with the interval timer.\n");
@@ -47,6 +73,10 @@ double fsecs(fsecs_test_funct f, void *argp)
 #if USE_FCYC
     double cycles = fcyc(f, argp);
     return cycles/(Mhz*1e6);
+#elif USE_TSC
+    if (tsc_ok)
+	return fcyc(f, argp)/(Mhz*1e6);
+    return ftimer_gettod(f, argp, 10);
 #elif USE_ITIMER
     return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
@@ -54,4 +84,38 @@ double fsecs(fsecs_test_funct f, void *argp)
 #endif 
 }
 
+/*
+ * fsecs_timer - Return the name of the timer selected in config.h
+ */
+const char *fsecs_timer(void)
+{
+#if USE_FCYC
+    return "fcyc";
+#elif USE_TSC
+    return tsc_ok ? "tsc" : "gettod";
+#elif USE_ITIMER
+    return "itimer";
+#elif USE_GETTOD
+    return "gettod";
+#endif 
+}
 
+/*
+ * fsecs_prep - Return the running time of a function f (in seconds),
+ *     calling prep before each run of f without timing it
+ */
+double fsecs_prep(fsecs_test_funct f, fsecs_test_funct prep, void *argp) 
+{
+#if USE_FCYC
+    double cycles = fcyc_prep(f, prep, argp);
+    return cycles/(Mhz*1e6);
+#elif USE_TSC
+    if (tsc_ok)
+	return fcyc_prep(f, prep, argp)/(Mhz*1e6);
+    return ftimer_gettod_prep(f, prep, argp, 10);
+#elif USE_ITIMER
+    return ftimer_itimer_prep(f, prep, argp, 10);
+#elif USE_GETTOD
+    return ftimer_gettod_prep(f, prep, argp, 10);
+#endif 
+}
@@ -2,3 +2,5 @@ typedef void (*fsecs_test_funct)(void *);
 
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+double fsecs_prep(fsecs_test_funct f, fsecs_test_funct prep, void *argp);
+const char *fsecs_timer(void);
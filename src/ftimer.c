@@ -7,8 +7,12 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *
+ * The _prep variants call prep(argp) before each run of f, outside of
+ * the timed region. ftimer_samples times each run on its own.
  */
 #include <stdio.h>
+#include <time.h>
 #include <sys/time.h>
 #include "ftimer.h"
 
@@ -52,6 +56,66 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
     return (1E-3*diff);
 }
 
+/* 
+ * ftimer_itimer_prep - Like ftimer_itimer, but call prep(argp) before
+ * each run without timing it. Return the average of n runs.
+ */
+double ftimer_itimer_prep(ftimer_test_funct f, ftimer_test_funct prep,
+			  void *argp, int n)
+{
+    double start, tmeas = 0;
+    int i;
+
+    init_etime();
+    for (i = 0; i < n; i++) {
+	prep(argp);
+	start = get_etime();
+	f(argp);
+	tmeas += get_etime() - start;
+    }
+    return tmeas / n;
+}
+
+/* 
+ * ftimer_gettod_prep - Like ftimer_gettod, but call prep(argp) before
+ * each run without timing it. Return the average of n runs.
+ */
+double ftimer_gettod_prep(ftimer_test_funct f, ftimer_test_funct prep,
+			  void *argp, int n)
+{
+    int i;
+    struct timeval stv, etv;
+    double diff = 0;
+
+    for (i = 0; i < n; i++) {
+	prep(argp);
+	gettimeofday(&stv, NULL);
+	f(argp);
+	gettimeofday(&etv, NULL);
+	diff += 1E3*(etv.tv_sec - stv.tv_sec) + 1E-3*(etv.tv_usec-stv.tv_usec);
+    }
+    diff /= n;
+    return (1E-3*diff);
+}
+
+/* 
+ * ftimer_samples - Time n runs of f(argp) one at a time with the 
+ * monotonic clock, storing the running time of run i in secs[i].
+ * gettimeofday's microsecond resolution is too coarse for single runs
+ * of the short traces.
+ */
+void ftimer_samples(ftimer_test_funct f, void *argp, double *secs, int n)
+{
+    int i;
+    struct timespec sts, ets;
+
+    for (i = 0; i < n; i++) {
+	clock_gettime(CLOCK_MONOTONIC, &sts);
+	f(argp);
+	clock_gettime(CLOCK_MONOTONIC, &ets);
+	secs[i] = (ets.tv_sec - sts.tv_sec) + 1E-9*(ets.tv_nsec - sts.tv_nsec);
+    }
+}
 
 /*
  * Routines for manipulating the Unix interval timer
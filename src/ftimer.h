@@ -12,3 +12,11 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/* Same as above, but call prep(argp) untimed before each run */
+double ftimer_itimer_prep(ftimer_test_funct f, ftimer_test_funct prep,
+			  void *argp, int n);
+double ftimer_gettod_prep(ftimer_test_funct f, ftimer_test_funct prep,
+			  void *argp, int n);
+
+/* Time each of n runs of f(argp) separately, storing them in secs */
+void ftimer_samples(ftimer_test_funct f, void *argp, double *secs, int n);
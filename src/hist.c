@@ -0,0 +1,69 @@
+/*
+ * hist.c - Log-bucketed latency histograms
+ */
+#include <string.h>
+
+#include "hist.h"
+
+/*
+ * hist_bucket - index of the bucket that v falls in. A value with its
+ *     highest set bit at position e >= HIST_SUB_BITS is kept to its top
+ *     HIST_SUB_BITS+1 bits.
+ */
+static int hist_bucket(unsigned long long v)
+{
+    int shift;
+
+    if (v < HIST_SUB)
+	return (int)v;
+    shift = (63 - __builtin_clzll(v)) - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB + (int)((v >> shift) - HIST_SUB);
+}
+
+/*
+ * hist_top - largest value that falls in bucket i
+ */
+static unsigned long long hist_top(int i)
+{
+    int shift = i / HIST_SUB - 1;
+    unsigned long long m = HIST_SUB + i % HIST_SUB;
+
+    if (shift < 0)
+	return (unsigned long long)i;
+    return ((m + 1) << shift) - 1;
+}
+
+void hist_clear(hist_t *h)
+{
+    memset(h, 0, sizeof(hist_t));
+}
+
+void hist_record(hist_t *h, unsigned long long v)
+{
+    h->counts[hist_bucket(v)]++;
+    h->total++;
+    if (v > h->max)
+	h->max = v;
+}
+
+unsigned long long hist_percentile(hist_t *h, double p)
+{
+    unsigned long long rank, seen = 0;
+    unsigned long long top;
+    int i;
+
+    if (h->total == 0)
+	return 0;
+    rank = (unsigned long long)(p * h->total);
+    if (rank < p * h->total || rank < 1)
+	rank++;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+	seen += h->counts[i];
+	if (seen >= rank) {
+	    /* The bucket's top can overshoot the largest value seen */
+	    top = hist_top(i);
+	    return top < h->max ? top : h->max;
+	}
+    }
+    return h->max;
+}
@@ -0,0 +1,33 @@
+/*
+ * hist.h - Log-bucketed latency histograms in the style of HdrHistogram
+ *
+ * Values below 2^HIST_SUB_BITS get a bucket each; above that, every
+ * power of two is split into 2^HIST_SUB_BITS buckets, so a recorded
+ * value is off by at most 1/2^HIST_SUB_BITS (about 3%) at any scale.
+ */
+#ifndef __HIST_H_
+#define __HIST_H_
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    unsigned long long counts[HIST_BUCKETS]; /* values in each bucket */
+    unsigned long long total;                /* values recorded */
+    unsigned long long max;                  /* largest value, exactly */
+} hist_t;
+
+/* Empty the histogram */
+void hist_clear(hist_t *h);
+
+/* Record one value */
+void hist_record(hist_t *h, unsigned long long v);
+
+/* 
+ * Value at or below which fraction p (0 < p <= 1) of the recorded 
+ * values lie, as the top of its bucket. Returns 0 if h is empty.
+ */
+unsigned long long hist_percentile(hist_t *h, double p);
+
+#endif /* __HIST_H_ */
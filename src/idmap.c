@@ -0,0 +1,147 @@
+/*
+ * idmap.c - Hash table from trace request ids to blocks
+ *
+ * Linear probing over a power-of-two table that doubles when it is 3/4
+ * full. Deletion shifts the following entries of the probe run back, 
+ * so there are no tombstones and lookups never slow down as ids come 
+ * and go.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "idmap.h"
+
+#define IDMAP_MINSIZE 1024   /* initial number of slots... */
+#define IDMAP_MINSHIFT 22    /* ... and 32 - log2 of it */
+
+/* 
+ * Fibonacci hashing spreads consecutive ids over the table. It takes
+ * the high bits of the product: the low ones of a multiple of 2^k are
+ * 0, and keys such as block sizes are often multiples of 16 or 4096.
+ */
+#define IDMAP_HASH(m, id) (((unsigned)(id) * 2654435769U) >> (m)->shift)
+
+/*
+ * idmap_alloc - allocate n empty slots
+ */
+static idmap_entry_t *idmap_alloc(size_t n)
+{
+    idmap_entry_t *table;
+    size_t i;
+
+    if ((table = (idmap_entry_t *)malloc(n * sizeof(idmap_entry_t))) == NULL) {
+	fprintf(stderr, "idmap: out of memory for %lu ids\n", 
+		(unsigned long)n);
+	exit(1);
+    }
+    for (i = 0; i < n; i++)
+	table[i].id = IDMAP_EMPTY;
+    return table;
+}
+
+/*
+ * idmap_grow - double the number of slots and rehash every live id
+ */
+static void idmap_grow(idmap_t *m)
+{
+    idmap_entry_t *old = m->table;
+    size_t i, j, n = m->mask + 1;
+
+    m->table = idmap_alloc(2 * n);
+    m->mask = 2 * n - 1;
+    m->shift--;
+    for (i = 0; i < n; i++) {
+	if (old[i].id == IDMAP_EMPTY)
+	    continue;
+	for (j = IDMAP_HASH(m, old[i].id); m->table[j].id != IDMAP_EMPTY; 
+	     j = (j + 1) & m->mask)
+	    ;
+	m->table[j] = old[i];
+    }
+    free(old);
+}
+
+/*
+ * idmap_new - create an empty map
+ */
+idmap_t *idmap_new(void)
+{
+    idmap_t *m;
+
+    if ((m = (idmap_t *)malloc(sizeof(idmap_t))) == NULL) {
+	fprintf(stderr, "idmap: out of memory\n");
+	exit(1);
+    }
+    m->table = idmap_alloc(IDMAP_MINSIZE);
+    m->mask = IDMAP_MINSIZE - 1;
+    m->shift = IDMAP_MINSHIFT;
+    m->count = 0;
+    return m;
+}
+
+/*
+ * idmap_get - find the entry for id
+ */
+idmap_entry_t *idmap_get(idmap_t *m, int id)
+{
+    size_t i;
+
+    for (i = IDMAP_HASH(m, id); m->table[i].id != IDMAP_EMPTY; 
+	 i = (i + 1) & m->mask)
+	if (m->table[i].id == id)
+	    return &m->table[i];
+    return NULL;
+}
+
+/*
+ * idmap_put - find the entry for id, or claim a slot for it
+ */
+idmap_entry_t *idmap_put(idmap_t *m, int id)
+{
+    size_t i;
+
+    if (4 * (m->count + 1) > 3 * (m->mask + 1))
+	idmap_grow(m);
+    for (i = IDMAP_HASH(m, id); m->table[i].id != IDMAP_EMPTY; 
+	 i = (i + 1) & m->mask)
+	if (m->table[i].id == id)
+	    return &m->table[i];
+    m->table[i].id = id;
+    m->table[i].ptr = NULL;
+    m->table[i].size = 0;
+    m->count++;
+    return &m->table[i];
+}
+
+/*
+ * idmap_del - remove id, then move back any later entry of the probe
+ *     run whose home slot is not between the hole and itself
+ */
+void idmap_del(idmap_t *m, int id)
+{
+    idmap_entry_t *e;
+    size_t hole, i, home;
+
+    if ((e = idmap_get(m, id)) == NULL)
+	return;
+    hole = e - m->table;
+    for (i = (hole + 1) & m->mask; m->table[i].id != IDMAP_EMPTY; 
+	 i = (i + 1) & m->mask) {
+	home = IDMAP_HASH(m, m->table[i].id);
+	if (((i - home) & m->mask) >= ((i - hole) & m->mask)) {
+	    m->table[hole] = m->table[i];
+	    hole = i;
+	}
+    }
+    m->table[hole].id = IDMAP_EMPTY;
+    m->count--;
+}
+
+/*
+ * idmap_free - free the map and its slots
+ */
+void idmap_free(idmap_t *m)
+{
+    free(m->table);
+    free(m);
+}
@@ -0,0 +1,42 @@
+/*
+ * idmap.h - Hash table from trace request ids to blocks, for replaying
+ *     traces whose ids are too many to give each one an array slot.
+ *     The table grows with the number of ids that are live at once.
+ */
+#ifndef __IDMAP_H_
+#define __IDMAP_H_
+
+#include <stddef.h>
+
+/* One live id and the block it names */
+typedef struct {
+    int id;              /* request id, IDMAP_EMPTY if the slot is free */
+    char *ptr;           /* payload returned by malloc/realloc */
+    size_t size;         /* payload size */
+} idmap_entry_t;
+
+typedef struct {
+    idmap_entry_t *table;  /* open-addressed slots, a power of two of them */
+    size_t mask;           /* number of slots - 1 */
+    unsigned shift;        /* 32 - log2(number of slots) */
+    size_t count;          /* live ids */
+} idmap_t;
+
+#define IDMAP_EMPTY (-1)
+
+/* Create an empty map; exits with a message if out of memory */
+idmap_t *idmap_new(void);
+
+/* Return the entry for id, or NULL if id is not in the map */
+idmap_entry_t *idmap_get(idmap_t *m, int id);
+
+/* Return the entry for id, adding it if need be */
+idmap_entry_t *idmap_put(idmap_t *m, int id);
+
+/* Remove id from the map, if it is there */
+void idmap_del(idmap_t *m, int id);
+
+/* Free the map */
+void idmap_free(idmap_t *m);
+
+#endif /* __IDMAP_H_ */
@@ -0,0 +1,261 @@
+/*
+ * libbench.c - Runs real programs on glibc's malloc and on libmm.so
+ *
+ * Each workload is a shell command that allocates heavily (sorting,
+ * awk, perl and python tables) over an input file of random lines the
+ * benchmark writes first. Every workload runs several times under
+ * each allocator, best time kept, with libmm.so preloaded for the
+ * second. The benchmark reports both times and peak resident sizes,
+ * and checks that the two allocators gave the same output.
+ *
+ * Workloads whose program isn't installed are skipped.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAXLINE       1024         /* max string size */
+#define DEFAULT_RUNS  3            /* default runs per allocator */
+#define DEFAULT_LINES 100000       /* default lines of input */
+#define DEFAULT_LIB   "./libmm.so" /* default allocator to preload */
+
+/* One program to run; $IN is the input file */
+typedef struct {
+    char *name;     /* short name for the report */
+    char *needs;    /* program that has to be installed */
+    char *cmd;      /* the shell command */
+} workload_t;
+
+static workload_t workloads[] = {
+    {"sort", "sort", "sort $IN"},
+    {"sort-u", "sort", "sort -u -k2 $IN"},
+    {"awk-hash", "awk",
+     "awk '{ n[$2]++; s[$1] = $0 } END { for (k in n) c++; print c }' $IN"},
+    {"awk-split", "awk",
+     "awk '{ a[NR] = $0 } END { for (i = NR; i > 0; i--) "
+     "{ split(a[i], f); t += length(f[2]) } print t }' $IN"},
+    {"perl-hash", "perl",
+     "perl -ne '$h{$_} = [split] } { print scalar(keys %h), \"\\n\"' $IN"},
+    {"python-dict", "python3",
+     "PYTHONMALLOC=malloc python3 -c 'import sys\n"
+     "d = {}\n"
+     "for l in open(sys.argv[1]): d.setdefault(l.split()[1], []).append(l)\n"
+     "print(len(d), sum(map(len, d.values())))' $IN"},
+    {NULL, NULL, NULL}
+};
+
+/* The result of one run */
+typedef struct {
+    double secs;               /* wall time */
+    long maxrss;               /* peak resident set, KB */
+    unsigned long long hash;   /* hash of the output */
+} run_t;
+
+/* Prints a message and exits */
+static void app_error(char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
+
+static void unix_error(char *msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+/*
+ * now - Return the current time in seconds
+ */
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1E-6*tv.tv_usec;
+}
+
+/*
+ * installed - Is the program on the PATH?
+ */
+static int installed(char *prog)
+{
+    char cmd[MAXLINE];
+
+    snprintf(cmd, sizeof(cmd), "command -v %s >/dev/null 2>&1", prog);
+    return system(cmd) == 0;
+}
+
+/*
+ * make_input - Write lines of "number word number" with random words
+ *     from a small vocabulary, so that the workloads have both many
+ *     distinct lines and many repeated keys
+ */
+static void make_input(char *path, int lines)
+{
+    FILE *fp;
+    int i, j, len;
+    char word[16];
+
+    if ((fp = fopen(path, "w")) == NULL)
+	unix_error("make_input: fopen failed");
+    srand(1);
+    for (i = 0; i < lines; i++) {
+	len = 3 + rand() % 10;
+	for (j = 0; j < len; j++)
+	    word[j] = 'a' + rand() % 4;
+	word[len] = '\0';
+	fprintf(fp, "%d %s %d\n", rand(), word, rand() % 1000);
+    }
+    if (fclose(fp) != 0)
+	unix_error("make_input: fclose failed");
+}
+
+/*
+ * run - Run the command once, with lib preloaded unless it is NULL,
+ *     and hash what it writes to stdout (FNV-1a)
+ */
+static void run(workload_t *w, char *lib, run_t *r)
+{
+    int fd[2], status;
+    pid_t pid;
+    ssize_t n, i;
+    unsigned char buf[65536];
+    struct rusage ru;
+    double start;
+
+    if (pipe(fd) < 0)
+	unix_error("run: pipe failed");
+    start = now();
+    if ((pid = fork()) < 0)
+	unix_error("run: fork failed");
+    if (pid == 0) {
+	dup2(fd[1], STDOUT_FILENO);
+	close(fd[0]);
+	close(fd[1]);
+	if (lib)
+	    setenv("LD_PRELOAD", lib, 1);
+	execl("/bin/sh", "sh", "-c", w->cmd, (char *)NULL);
+	_exit(127);
+    }
+    close(fd[1]);
+    r->hash = 14695981039346656037ULL;
+    while ((n = read(fd[0], buf, sizeof(buf))) > 0)
+	for (i = 0; i < n; i++)
+	    r->hash = (r->hash ^ buf[i]) * 1099511628211ULL;
+    close(fd[0]);
+    if (wait4(pid, &status, 0, &ru) < 0)
+	unix_error("run: wait4 failed");
+    r->secs = now() - start;
+    r->maxrss = ru.ru_maxrss;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+	fprintf(stderr, "%s failed%s\n", w->name, lib ? " under libmm" : "");
+	r->secs = -1;
+    }
+}
+
+/*
+ * best - Run the command nruns times and keep the fastest run. A run
+ *     with different output counts as a failure.
+ */
+static void best(workload_t *w, char *lib, int nruns, run_t *b)
+{
+    run_t r;
+    int i;
+
+    for (i = 0; i < nruns; i++) {
+	run(w, lib, &r);
+	if (r.secs < 0 || (i > 0 && r.hash != b->hash)) {
+	    b->secs = -1;
+	    return;
+	}
+	if (i == 0 || r.secs < b->secs)
+	    *b = r;
+    }
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: libbench [-h] [-n <runs>] [-N <lines>] "
+	    "[-l <lib>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-l <lib>   Allocator to preload (default %s).\n",
+	    DEFAULT_LIB);
+    fprintf(stderr, "\t-n <runs>  Runs per allocator (default %d).\n",
+	    DEFAULT_RUNS);
+    fprintf(stderr, "\t-N <lines> Lines of input (default %d).\n",
+	    DEFAULT_LINES);
+}
+
+int main(int argc, char **argv)
+{
+    char c;
+    char *lib = DEFAULT_LIB;
+    char libpath[MAXLINE], input[] = "/tmp/libbench-XXXXXX";
+    int nruns = DEFAULT_RUNS, lines = DEFAULT_LINES;
+    int fd, failed = 0;
+    workload_t *w;
+    run_t g, m;
+
+    while ((c = getopt(argc, argv, "hn:N:l:")) != EOF) {
+	switch (c) {
+	case 'n':
+	    nruns = atoi(optarg);
+	    break;
+	case 'N':
+	    lines = atoi(optarg);
+	    break;
+	case 'l':
+	    lib = optarg;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (nruns < 1 || lines < 1)
+	app_error("libbench: -n and -N must be positive");
+
+    /* The workloads run in the shell's directory, so pass a full path */
+    if (realpath(lib, libpath) == NULL)
+	unix_error("libbench: can't find the allocator library");
+    if ((fd = mkstemp(input)) < 0)
+	unix_error("libbench: mkstemp failed");
+    close(fd);
+    make_input(input, lines);
+    setenv("IN", input, 1);
+
+    printf("%d lines, best of %d runs, %s\n\n", lines, nruns, libpath);
+    printf("%-12s%10s%10s%8s%12s%12s  %s\n", "workload", "glibc",
+	   "libmm", "ratio", "glibc RSS", "libmm RSS", "output");
+    for (w = workloads; w->name; w++) {
+	if (!installed(w->needs)) {
+	    printf("%-12s  (no %s)\n", w->name, w->needs);
+	    continue;
+	}
+	fflush(stdout);
+	best(w, NULL, nruns, &g);
+	best(w, libpath, nruns, &m);
+	if (g.secs < 0 || m.secs < 0) {
+	    printf("%-12s  failed\n", w->name);
+	    failed = 1;
+	    continue;
+	}
+	printf("%-12s%9.3fs%9.3fs%8.2f%10ldKB%10ldKB  %s\n", w->name,
+	       g.secs, m.secs, m.secs / g.secs, g.maxrss, m.maxrss,
+	       g.hash == m.hash ? "same" : "DIFFERS");
+	if (g.hash != m.hash)
+	    failed = 1;
+    }
+    unlink(input);
+    exit(failed);
+}
@@ -0,0 +1,233 @@
+/*
+ * libmm.c - The mm package as the process's malloc. Preload libmm.so
+ *     to run a real program on it:
+ *
+ *         LD_PRELOAD=./libmm.so sort big.txt
+ *
+ * memlib's heap is already real memory (one mmap), so this only has to
+ * set it up on the first call, whichever thread makes it, serialize the
+ * calls with memlib's lock (mem_set_threaded), and keep that lock out
+ * of fork: a child forked while another thread held it would otherwise
+ * deadlock on its first malloc.
+ *
+ * The heap is LIBMM_HEAP megabytes (DEF_HEAP_MB if unset), mapped up
+ * front but only backed by memory as it is touched. It can't grow past
+ * that: mm.c links free blocks by 32-bit heap offsets, which also caps
+ * it at 4 GB. Blocks of MAP_THRESHOLD bytes or more get mappings of
+ * their own, outside the heap.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define DEF_HEAP_MB 1024   /* default heap size */
+#define MAX_HEAP_MB 4095   /* heap offsets are 32 bits */
+
+/*
+ * Callers may keep any type in a block, so blocks are aligned like
+ * glibc's: to 16 bytes on 64-bit systems, 8 on 32-bit ones
+ */
+#define LIBMM_ALIGN (2 * sizeof(size_t))
+
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+/*
+ * init - map the heap and initialize the mm package (run once)
+ */
+static void init(void)
+{
+    char *s = getenv("LIBMM_HEAP");
+    unsigned long mb = s ? strtoul(s, NULL, 10) : DEF_HEAP_MB;
+    static const char msg[] = "libmm: mm_init failed\n";
+
+    if (mb == 0 || mb > MAX_HEAP_MB)
+	mb = DEF_HEAP_MB;
+    mem_set_maxheap((size_t)mb << 20);
+    mem_init();
+    mem_set_threaded(1);
+    if (mm_init() < 0) {
+	/* not fprintf, which may call malloc */
+	if (write(STDERR_FILENO, msg, sizeof(msg) - 1) < 0)
+	    ;
+	abort();
+    }
+}
+
+/*
+ * Hold the heap lock across fork, so that the child gets a consistent
+ * heap and an unlocked lock
+ */
+static void fork_prepare(void)
+{
+    mem_lock();
+}
+
+static void fork_parent(void)
+{
+    mem_unlock();
+}
+
+static void fork_child(void)
+{
+    mem_unlock();
+}
+
+/*
+ * libmm_load - set up the heap as soon as the library is loaded, and
+ *     register the fork handlers. pthread_atfork may itself call
+ *     malloc, so it can't be called from init.
+ */
+__attribute__((constructor))
+static void libmm_load(void)
+{
+    pthread_once(&once, init);
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+/*
+ * ours - is ptr a block of the mm package? Anything else (e.g. memory
+ *     the dynamic linker allocated before we were loaded) is left alone.
+ *     Mapped blocks are recognized by the tag in their header, not by
+ *     searching memlib's reservations, so this takes constant time.
+ */
+static int ours(void *ptr)
+{
+    if ((char *)ptr >= (char *)mem_heap_lo() &&
+	(char *)ptr <= (char *)mem_heap_hi())
+	return 1;
+    return mm_mapped(ptr);
+}
+
+/*
+ * aligned - allocate size bytes aligned to alignment, at least to
+ *     LIBMM_ALIGN, setting errno if we are out of memory
+ */
+static void *aligned(size_t alignment, size_t size)
+{
+    void *ptr;
+
+    pthread_once(&once, init);
+    if (size == 0)
+	size = 1;
+    if (size > (size_t)INT32_MAX) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if (alignment < LIBMM_ALIGN)
+	alignment = LIBMM_ALIGN;
+    if ((ptr = mm_memalign(alignment, size)) == NULL)
+	errno = ENOMEM;
+    return ptr;
+}
+
+/************************
+ * The exported functions
+ ************************/
+
+void *malloc(size_t size)
+{
+    return aligned(LIBMM_ALIGN, size);
+}
+
+void free(void *ptr)
+{
+    if (ptr != NULL && ours(ptr))
+	mm_free(ptr);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    void *ptr;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if ((ptr = aligned(LIBMM_ALIGN, nmemb * size)) != NULL)
+	memset(ptr, 0, nmemb * size);
+    return ptr;
+}
+
+/*
+ * realloc - mm_realloc doesn't keep LIBMM_ALIGN, so a block it moves
+ *     to a less aligned address is moved once more
+ */
+void *realloc(void *ptr, size_t size)
+{
+    void *newptr, *p;
+
+    if (ptr == NULL)
+	return malloc(size);
+    if (size == 0) {
+	free(ptr);
+	return NULL;
+    }
+    if (!ours(ptr) || size > (size_t)INT32_MAX) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if ((newptr = mm_realloc(ptr, size)) == NULL) {
+	errno = ENOMEM;
+	return NULL;
+    }
+    if (((uintptr_t)newptr & (LIBMM_ALIGN - 1)) == 0)
+	return newptr;
+    if ((p = aligned(LIBMM_ALIGN, size)) == NULL)
+	return newptr;
+    memcpy(p, newptr, size);
+    mm_free(newptr);
+    return p;
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *ptr;
+
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0 ||
+	alignment % sizeof(void *) != 0)
+	return EINVAL;
+    if ((ptr = aligned(alignment, size)) == NULL)
+	return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+	errno = EINVAL;
+	return NULL;
+    }
+    return aligned(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    return memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+    return aligned(mem_pagesize(), size);
+}
+
+void *pvalloc(size_t size)
+{
+    size_t pagesize = mem_pagesize();
+
+    return aligned(pagesize, (size + pagesize - 1) & ~(pagesize - 1));
+}
+
+size_t malloc_usable_size(void *ptr)
+{
+    if (ptr == NULL || !ours(ptr))
+	return 0;
+    return mm_usable_size(ptr);
+}
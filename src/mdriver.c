@@ -7,18 +7,33 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE  /* for sched_setaffinity */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <dlfcn.h>
+#include <fcntl.h>
 #include <string.h>
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <getopt.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/wait.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "ftimer.h"
+#include "clock.h"
+#include "hist.h"
+#include "sample.h"
+#include "perfctr.h"
+#include "cache.h"
+#include "tracefile.h"
 #include "config.h"
 
 /**********************
@@ -29,6 +44,24 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define RANGE_CHUNK 1024 /* range records allocated at once for the pool */
+
+/* Baseline comparisons (-b) */
+#define MAX_SAMPLES  100 /* most timed runs kept per trace (-n) */
+#define DEF_SAMPLES   30 /* timed runs per trace with -b but no -n */
+#define ALPHA       0.05 /* significance level of the comparison */
+#define NBOOT       2000 /* bootstrap resamples for the speedup's CI */
+#define MIN_CHANGE  0.05 /* smaller speedups are within run-to-run drift */
+
+/* Stability mode (-R) */
+#define STABLE_WARMUP 5    /* default warm-up runs before the samples */
+#define NOISY_MAD     0.05 /* noisy if the MAD is above this * median */
+
+/* Utilization over time (-U) */
+#define UTIL_WINDOW   10 /* the worst window spans 1/UTIL_WINDOW of a trace */
+
+/* -z never credits a trace with more than 1/MIN_NET times its raw speed */
+#define MIN_NET     0.05
 
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
@@ -37,29 +70,40 @@
  * The key compound data types 
  *****************************/
 
-/* Records the extent of each block's payload */
+/* 
+ * Records the extent of each block's payload. The records form an AVL
+ * tree ordered by lo; payloads never overlap, so that orders them by
+ * hi as well.
+ */
 typedef struct range_t {
     char *lo;              /* low payload address */
     char *hi;              /* high payload address */
-    struct range_t *next;  /* next list element */
+    struct range_t *left;  /* ranges below lo (next free record in pool) */
+    struct range_t *right; /* ranges above hi */
+    int height;            /* height of the subtree rooted here */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
+/* 
+ * Holds the information for one trace file. The requests (traceop_t, 
+ * see tracefile.h) belong to the tracefile_t that tf_read returned; 
+ * for binary traces they are used in place in the mapped file. A
+ * GALLOC request allocates a growable block (mm_galloc); later 
+ * reallocs and frees of that id are GROW (mm_grow) and GFREE (mm_gfree).
+ * The timed replays read a copy of the requests split into one array
+ * per field, which takes 9 bytes a request rather than 12.
+ */
 typedef struct {
     int sugg_heapsize;   /* suggested heap size (unused) */
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
     int weight;          /* weight for this trace (unused) */
     traceop_t *ops;      /* array of requests */
+    unsigned char *op_types; /* the requests' types... */
+    int32_t *op_ids;     /* ... ids ... */
+    int32_t *op_sizes;   /* ... and sizes, for the timed replays */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    tracefile_t *tf;     /* the trace file the requests came from */
 } trace_t;
 
 /* 
@@ -81,10 +125,73 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double cold_secs;/* secs needed on a cold (unfaulted) heap (-C only) */
+    double evict_secs;/* secs needed after evicting the caches (-x only) */
+    double copied;   /* payload bytes copied by reallocs that moved */
+    double remapped; /* bytes reallocs moved by remapping pages instead */
+    double grown;    /* payload bytes added in place to growable blocks */
+    double avg_util; /* utilization averaged over the trace (-U only) */
+    double worst_util;/* ... and over its worst window (-U only) */
+    double bump_secs;/* secs to replay it with a bump allocator (-z only) */
+    double fixed_secs;/* ... and with one returning a fixed pointer (-z) */
+
+    /* defined only with -n or -b; secs is then their median */
+    int nsamples;                 /* number of timed runs... */
+    double samples[MAX_SAMPLES];  /* ... and the secs of each */
+
+    /* defined only with -e: one run's events, -1 if not counted */
+    int counted;                  /* were any events counted? */
+    double events[PC_NEVENTS];    /* perfctr_stop's counts */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
+/* A trace's mm stats in the -o json results of an earlier run (-b) */
+typedef struct {
+    char *file;      /* the trace file, as given to that run */
+    stats_t mm;      /* its secs and samples */
+} baseline_t;
+
+/* One of the threads that replay a trace at once (-T) */
+typedef struct {
+    trace_t *trace;            /* the trace being replayed */
+    int libc;                  /* set to replay through libc malloc */
+    int id;                    /* thread number */
+    char **blocks;             /* this thread's blocks, by request id */
+    double ops;                /* requests this thread issues per run */
+    double secs;               /* its time in the last run... */
+    double best;               /* ... and in its fastest run */
+    pthread_t tid;
+    pthread_barrier_t *start;  /* lines the threads up before each run */
+} replay_t;
+
+/* 
+ * A trace's request latencies (-L), in TSC ticks, for each of malloc,
+ * free and realloc: the rows printlatency prints, rather than the
+ * histograms, which are too big to send back through a -j pipe
+ */
+typedef struct {
+    int measured;                 /* was the trace timed request by request? */
+    unsigned long long ovhd;      /* read_tsc overhead subtracted */
+    unsigned long long count[3];  /* requests of each kind */
+    unsigned long long p50[3], p99[3], p999[3], max[3];
+} latency_t;
+
+/* What a -j worker sends back to main for the trace it evaluated */
+typedef struct {
+    int tracenum;        /* which trace */
+    int errors;          /* errors found in the mm package */
+    stats_t libc;        /* libc stats (-l only) */
+    stats_t mm;          /* mm stats */
+    latency_t latency;   /* mm latencies (-L only) */
+} result_t;
+
+/* Holds the params to eval_mm_stream_run, which is timed by ftimer */
+typedef struct {
+    tfstream_t *stream;  /* the trace being streamed */
+    stats_t *stats;      /* receives the utilization */
+} stream_t;
+
 /********************
  * Global variables
  *******************/
@@ -95,6 +202,64 @@ char msg[MAXLINE];      /* for whenever we need to compose an error message */
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
+/* How each trace is evaluated, set by the command line options */
+static int run_libc = 0;    /* If set, run libc malloc (set by -l) */
+static int prefault = 0;    /* If set, pre-fault the heap before timing (-P) */
+static int cold_heap = 0;   /* If set, also time runs on a cold heap (-C) */
+static int cold_cache = 0;  /* If set, also time runs on cold caches (-x) */
+static int stream = 0;      /* If set, stream each trace in one pass (-S) */
+static int nthreads = 1;    /* Threads that replay each trace at once (-T) */
+static int shard = 0;       /* If set, the threads split the trace by id (-s) */
+static int latency = 0;     /* If set, print per-request latencies (-L) */
+static latency_t *latencies; /* ... and those of each trace */
+static int nsamples = 0;    /* If set, time this many runs one by one (-n) */
+static int warmup = -1;     /* Untimed runs before those (-w, default 1) */
+static int stable = 0;      /* If set, pin and report the spread (-R) */
+static int stable_cpu = -1; /* The CPU -R pinned the driver to */
+static size_t max_heap = MAX_HEAP; /* Size of the simulated heap (-H) */
+static int util_every = 0;  /* If set, sample utilization this often (-U) */
+static int counters = 0;    /* If set, count hardware events (-e) */
+static int net = 0;         /* If set, subtract the replay's own time (-z) */
+static int quick = 0;       /* If set, check the traces but don't time them (-q) */
+static int check_every = 1; /* Fill and check the payloads of ids that are
+			       multiples of this (-k) */
+static char *curve_path = NULL; /* Where -U writes the samples (--curve) */
+
+/* 
+ * The package being evaluated: mm.c as linked into the driver, or one
+ * of the shared objects given with -m
+ */
+static mm_plugin_t builtin = {
+    "mm", mm_init, mm_malloc, mm_free, mm_realloc, mm_config, 
+    mm_free_bytes, NULL, mm_galloc, mm_grow, mm_gfree
+};
+static mm_plugin_t *mm = &builtin;
+
+/*
+ * Null allocators, which do no work, for timing the replay itself (-z).
+ * One hands out consecutive addresses and never frees, the other 
+ * returns the same address every time. They are called through mm like
+ * any package.
+ */
+static int null_init(void);
+static void *bump_malloc(size_t size);
+static void *bump_realloc(void *ptr, size_t size);
+static void *bump_galloc(size_t size, size_t maxsize);
+static void *fixed_malloc(size_t size);
+static void *fixed_realloc(void *ptr, size_t size);
+static void *fixed_galloc(size_t size, size_t maxsize);
+static void null_free(void *ptr);
+static int null_grow(void *ptr, size_t size);
+
+static mm_plugin_t null_bump = {
+    "bump", null_init, bump_malloc, null_free, bump_realloc, NULL, NULL,
+    NULL, bump_galloc, null_grow, null_free
+};
+static mm_plugin_t null_fixed = {
+    "fixed", null_init, fixed_malloc, null_free, fixed_realloc, NULL, NULL,
+    NULL, fixed_galloc, null_grow, null_free
+};
+
 /* The filenames of the default tracefiles */
 static char *default_tracefiles[] = {  
     DEFAULT_TRACEFILES, NULL
@@ -105,7 +270,7 @@ static char *default_tracefiles[] = {
  * Function prototypes 
  *********************/
 
-/* these functions manipulate range lists */
+/* these functions manipulate the range tree */
 static int add_range(range_t **ranges, char *lo, int size, 
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
@@ -121,12 +286,64 @@ static void eval_libc_speed(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed 
    of the student's malloc package in mm.c */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
+static int eval_mm_check(trace_t *trace, int tracenum, range_t **ranges,
+			 stats_t *stats);
 static void eval_mm_speed(void *ptr);
+static void discard_heap(void *ptr);
+static void evict_cache(void *ptr);
+static void eval_mm_stream(char *path, stats_t *stats);
+static void eval_mm_stream_run(void *ptr);
+static void eval_mm_latency(trace_t *trace, latency_t *lat);
+static void time_harness(speed_t *speed_params, stats_t *stats);
+static double trace_secs(stats_t *s);
+
+/* These functions evaluate the traces, one at a time or in parallel */
+static void eval_libc_trace(char *filename, int tracenum, stats_t *stats);
+static void eval_mm_trace(char *filename, int tracenum, stats_t *stats);
+static void eval_parallel(char **tracefiles, int num_tracefiles, int jobs,
+			  int *cpus, int ncpus, stats_t *libc_stats, 
+			  stats_t *mm_stats);
+static int parse_cpus(char *list, int **cpus);
+static mm_plugin_t *load_plugin(char *path);
+static void pin_driver(int *cpus, int ncpus, int jobs);
+static void cpu_governor(int cpu, char *buf, int len);
+static int cpu_turbo(void);
+
+/* These functions replay a trace on several threads at once */
+static double eval_threads(trace_t *trace, int tracenum, int libc, 
+			   stats_t *stats);
+static void eval_threads_speed(void *ptr);
+static void *replay_thread(void *ptr);
+static double time_trace(fsecs_test_funct f, void *argp, stats_t *stats);
+static void count_trace(fsecs_test_funct f, void *argp, stats_t *stats);
+
+/* Comparing against a baseline run (-b) */
+static int read_baseline(char *path, baseline_t **base);
+static char *trace_name(char *path);
+static int compare_baseline(char *path, char **tracefiles, int n, 
+			    stats_t *mm_stats);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printcold(int n, stats_t *stats);
+static void printcache(int n, stats_t *stats);
+static void printharness(int n, stats_t *stats);
+static void printcopy(int n, stats_t *stats);
+static void printutil(int n, stats_t *stats);
+static void printevents(int n, stats_t *stats);
+static void printlatency(int n);
+static void printstable(int n, stats_t *stats, int *cpus, int ncpus, 
+			int jobs);
+static void printplugins(int n, char **names, stats_t **stats, 
+			 int *nerrors, int nplugins);
+static double perf_index(int n, stats_t *stats, int nerrors, double *p1, 
+			 double *p2);
+static void printjson(FILE *out, char **tracefiles, int n, 
+		      stats_t *libc_stats, stats_t *mm_stats, 
+		      double perfindex);
+static void printcsv(FILE *out, char **tracefiles, int n, 
+		     stats_t *libc_stats, stats_t *mm_stats, 
+		     double perfindex);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -141,23 +358,46 @@ int main(int argc, char **argv)
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
-    trace_t *trace = NULL;     /* stores a single trace file in memory */
-    range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
-    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
-    int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int jobs = 1;        /* Traces evaluated at once, each in a child (-j) */
+    int *cpus = NULL;    /* CPUs to pin the children to (-p)... */
+    int ncpus = 0;       /* ... and how many there are */
+    char *outfmt = NULL; /* Machine-readable results format (-o)... */
+    FILE *out = NULL;    /* ... and where they go */
+    char *baseline = NULL; /* Results of an earlier run to compare to (-b) */
+    int regressed = 0;   /* Traces significantly slower than in baseline */
+    FILE *out_curve;     /* The --curve file, while we write its header */
+    char **plugin_files = NULL; /* Shared objects to evaluate (-m)... */
+    mm_plugin_t **plugins = NULL; /* ... the packages they export ... */
+    stats_t **plugin_stats = NULL; /* ... their stats for each trace ... */
+    int *plugin_errors = NULL; /* ... and their errors */
+    int nplugins = 0, k;
+    int fd;
+    static struct option longopts[] = {
+	{"baseline", required_argument, NULL, 'b'},
+	{"samples", required_argument, NULL, 'n'},
+	{"curve", required_argument, NULL, 'c'},
+	{"stable", no_argument, NULL, 'R'},
+	{"warmup", required_argument, NULL, 'w'},
+	{"cold-cache", no_argument, NULL, 'x'},
+	{"net", no_argument, NULL, 'z'},
+	{"quick", no_argument, NULL, 'q'},
+	{"help", no_argument, NULL, 'h'},
+	{NULL, 0, NULL, 0}
+    };
 
     /* temporaries used to compute the performance index */
-    double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
+    double p1, p2, perfindex;
     int numcorrect;
     
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt_long(argc, argv, "f:t:hvVgalPCSj:p:T:sLo:b:n:H:U:eRw:xm:zqk:",
+			    longopts, NULL)) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -180,6 +420,111 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'P': /* Pre-fault the simulated heap before timing */
+            prefault = 1;
+            break;
+        case 'C': /* Also time the mm package on a cold heap */
+            cold_heap = 1;
+            break;
+        case 'S': /* Stream the traces instead of reading them in first */
+            stream = 1;
+            break;
+        case 'j': /* Evaluate this many traces at once */
+            jobs = atoi(optarg);
+	    if (jobs < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'p': /* Pin the -j children to these CPUs */
+	    if ((ncpus = parse_cpus(optarg, &cpus)) < 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'T': /* Replay each trace on this many threads at once */
+            nthreads = atoi(optarg);
+	    if (nthreads < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 's': /* Split the trace between the threads by id */
+            shard = 1;
+            break;
+        case 'e': /* Count hardware events in a run of each trace */
+            counters = 1;
+            break;
+        case 'L': /* Print latency percentiles for each trace */
+            latency = 1;
+            break;
+        case 'o': /* Write the results as json or csv */
+	    if (strcmp(optarg, "json") && strcmp(optarg, "csv")) {
+		usage();
+		exit(1);
+	    }
+            outfmt = optarg;
+            break;
+        case 'b': /* Compare the timings to an earlier run's -o json */
+            baseline = optarg;
+            break;
+        case 'H': /* Size of the simulated heap, in MB */
+	    if (atoi(optarg) < 1) {
+		usage();
+		exit(1);
+	    }
+            max_heap = (size_t)atoi(optarg) << 20;
+            break;
+        case 'U': /* Sample the utilization every this many requests */
+            util_every = atoi(optarg);
+	    if (util_every < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'c': /* Write the -U samples to this file (--curve only) */
+            curve_path = optarg;
+            break;
+        case 'n': /* Time this many runs of each trace one at a time */
+            nsamples = atoi(optarg);
+	    if (nsamples < 2 || nsamples > MAX_SAMPLES) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'm': /* Evaluate the package in this shared object */
+	    plugin_files = realloc(plugin_files, 
+				   (nplugins+1) * sizeof(char *));
+	    if (plugin_files == NULL)
+		unix_error("ERROR: realloc failed in main");
+	    plugin_files[nplugins++] = optarg;
+            break;
+        case 'x': /* Also time each trace after evicting the caches */
+            cold_cache = 1;
+            break;
+        case 'z': /* Subtract the time of the replay itself */
+            net = 1;
+            break;
+        case 'q': /* Check the traces and their utilization only */
+            quick = 1;
+            break;
+        case 'k': /* Check the payloads of every k-th block id only */
+            check_every = atoi(optarg);
+	    if (check_every < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'R': /* Pin the driver, warm up, and report the spread */
+            stable = 1;
+            break;
+        case 'w': /* Run each trace this many times before timing it */
+            warmup = atoi(optarg);
+	    if (warmup < 0) {
+		usage();
+		exit(1);
+	    }
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
@@ -195,6 +540,78 @@ int main(int argc, char **argv)
         }
     }
 	
+    /* A streamed trace is replayed once, and the cold runs single-threaded */
+    if (nthreads > 1 && (stream || cold_heap || cold_cache)) {
+	fprintf(stderr, "mdriver: -T can't be combined with -S, -C or -x\n");
+	exit(1);
+    }
+    if (stream && cold_cache) {
+	fprintf(stderr, "mdriver: -S replays each trace once, so it can't "
+		"be combined with -x\n");
+	exit(1);
+    }
+    if (stable && nthreads > 1) {
+	fprintf(stderr, "mdriver: -R pins the driver to one CPU, so it "
+		"can't be combined with -T\n");
+	exit(1);
+    }
+    if (stable && jobs > 1 && ncpus == 0) {
+	fprintf(stderr, "mdriver: with -R, give the -j children CPUs of "
+		"their own with -p\n");
+	exit(1);
+    }
+    if ((baseline || stable) && nsamples == 0)
+	nsamples = DEF_SAMPLES;
+    if (warmup < 0)
+	warmup = stable ? STABLE_WARMUP : 1;
+    if (curve_path && !util_every)
+	util_every = 1000;
+    if (stream && util_every) {
+	fprintf(stderr, "mdriver: -S measures utilization its own way, so it "
+		"can't be combined with -U\n");
+	exit(1);
+    }
+    if (quick && (run_libc || stream || nthreads > 1 || nsamples || 
+		  baseline || stable || cold_heap || cold_cache || counters ||
+		  net || latency || outfmt || nplugins > 1)) {
+	fprintf(stderr, "mdriver: -q doesn't time the traces, so it can only "
+		"be combined with -f, -t, -j, -p, -m (once), -H, -P, -U, -g "
+		"and -v\n");
+	exit(1);
+    }
+    if (net && (stream || nthreads > 1)) {
+	fprintf(stderr, "mdriver: -z times single-threaded replays of a "
+		"trace in memory, so it can't be combined with -S or -T\n");
+	exit(1);
+    }
+    if (counters && (stream || nthreads > 1)) {
+	fprintf(stderr, "mdriver: -e counts the events of a single-threaded "
+		"replay, so it can't be combined with -S or -T\n");
+	exit(1);
+    }
+    if (stream && nsamples) {
+	fprintf(stderr, "mdriver: -S replays each trace once, so it can't "
+		"be combined with -n, -b or -R\n");
+	exit(1);
+    }
+    if (stream && latency) {
+	fprintf(stderr, "mdriver: -S replays each trace once, so it can't "
+		"be combined with -L\n");
+	exit(1);
+    }
+
+    /* 
+     * With -o, the results own stdout; everything else we print goes
+     * to stderr, so scripts can read stdout as is
+     */
+    if (outfmt) {
+	fflush(stdout);
+	if ((fd = dup(STDOUT_FILENO)) < 0 || (out = fdopen(fd, "w")) == NULL)
+	    unix_error("dup failed in main");
+	if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+	    unix_error("dup2 failed in main");
+    }
+
     /* 
      * If no -f command line arg, then use the entire set of tracefiles 
      * defined in default_traces[]
@@ -205,76 +622,134 @@ int main(int argc, char **argv)
 	printf("Using default tracefiles in %s\n", tracedir);
     }
 
-    /* Initialize the timing package */
-    init_fsecs();
+    /* Start the -U curve file, which each trace appends to */
+    if (curve_path) {
+	if ((out_curve = fopen(curve_path, "w")) == NULL)
+	    unix_error("Could not open the --curve file");
+	fprintf(out_curve, "trace,op,live,peak_live,footprint,peak_footprint,"
+		"free,util\n");
+	fclose(out_curve);
+    }
 
-    /*
-     * Optionally run and evaluate the libc malloc package 
+    /* See which hardware events we can count before trying every trace */
+    if (counters) {
+	if (perfctr_open() == 0) {
+	    printf("mdriver: no hardware event counters (no PMU, or "
+		   "perf_event_paranoid > 2); ignoring -e\n");
+	    counters = 0;
+	}
+	perfctr_close();
+    }
+
+    /* 
+     * Load the -m packages. The first one is then evaluated in place of
+     * mm.c, and its results are the ones reported below and in -o.
      */
+    if (nplugins > 0) {
+	plugins = (mm_plugin_t **)calloc(nplugins, sizeof(mm_plugin_t *));
+	plugin_stats = (stats_t **)calloc(nplugins, sizeof(stats_t *));
+	plugin_errors = (int *)calloc(nplugins, sizeof(int));
+	if (plugins == NULL || plugin_stats == NULL || plugin_errors == NULL)
+	    unix_error("plugins calloc in main failed");
+	for (k = 0; k < nplugins; k++)
+	    plugins[k] = load_plugin(plugin_files[k]);
+	mm = plugins[0];
+    }
+
+    /* Keep the driver on one CPU, so the runs don't migrate */
+    if (stable)
+	pin_driver(cpus, ncpus, jobs);
+
+    /* Initialize the timing package */
+    if (!quick)
+	init_fsecs();
+
+    /* Allocate the stats arrays, with one stats_t struct per tracefile */
     if (run_libc) {
-	if (verbose > 1)
-	    printf("\nTesting libc malloc\n");
-	
-	/* Allocate libc stats array, with one stats_t struct per tracefile */
 	libc_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
 	if (libc_stats == NULL)
 	    unix_error("libc_stats calloc in main failed");
-	
-	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-	    }
-	    free_trace(trace);
-	}
-
-	/* Display the libc results in a compact table */
-	if (verbose) {
-	    printf("\nResults for libc malloc:\n");
-	    printresults(num_tracefiles, libc_stats);
-	}
     }
-
-    /*
-     * Always run and evaluate the student's mm package
-     */
-    if (verbose > 1)
-	printf("\nTesting mm malloc\n");
-
-    /* Allocate the mm stats array, with one stats_t struct per tracefile */
     mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
     if (mm_stats == NULL)
 	unix_error("mm_stats calloc in main failed");
+    if (latency) {
+	latencies = (latency_t *)calloc(num_tracefiles, sizeof(latency_t));
+	if (latencies == NULL)
+	    unix_error("latencies calloc in main failed");
+    }
     
-    /* Initialize the simulated memory system in memlib.c */
+    /* 
+     * Initialize the simulated memory system in memlib.c, with room for
+     * every thread's copy of a trace in -T mode
+     */
+    if (nthreads > 1 && !shard)
+	mem_set_maxheap((size_t)nthreads * max_heap);
+    else
+	mem_set_maxheap(max_heap);
     mem_init(); 
 
-    /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
+    /* 
+     * Each trace is evaluated in a child of its own with -j, and also
+     * when several -m packages are compared, so that one that crashes
+     * only fails its own traces
+     */
+    if (jobs > 1 || nplugins > 1) {
+	eval_parallel(tracefiles, num_tracefiles, jobs, cpus, ncpus,
+		      libc_stats, mm_stats);
+    }
+    else {
+	/* Optionally run and evaluate the libc malloc package */
+	if (run_libc) {
 	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+		printf("\nTesting libc malloc\n");
+	    for (i=0; i < num_tracefiles; i++)
+		eval_libc_trace(tracefiles[i], i, &libc_stats[i]);
 	}
-	free_trace(trace);
+
+	/* Always run and evaluate the student's mm package */
+	if (verbose > 1)
+	    printf("\nTesting mm malloc\n");
+	for (i=0; i < num_tracefiles; i++)
+	    eval_mm_trace(tracefiles[i], i, &mm_stats[i]);
+    }
+
+    /* Display the request latencies, in trace order even with -j */
+    if (latency)
+	printlatency(num_tracefiles);
+
+    /* Then run every other -m package on the same traces */
+    if (nplugins > 0) {
+	plugin_stats[0] = mm_stats;
+	plugin_errors[0] = errors;
+    }
+    for (k = 1; k < nplugins; k++) {
+	if (verbose > 1)
+	    printf("\nTesting %s\n", plugin_files[k]);
+	plugin_stats[k] = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+	if (plugin_stats[k] == NULL)
+	    unix_error("plugin_stats calloc in main failed");
+	mm = plugins[k];
+	errors = 0;
+	if (jobs > 1 || nplugins > 1)
+	    eval_parallel(tracefiles, num_tracefiles, jobs, cpus, ncpus,
+			  NULL, plugin_stats[k]);
+	else
+	    for (i=0; i < num_tracefiles; i++)
+		eval_mm_trace(tracefiles[i], i, &plugin_stats[k][i]);
+	plugin_errors[k] = errors;
+	if (latency)
+	    printlatency(num_tracefiles);
+    }
+    if (nplugins > 0) {
+	mm = plugins[0];
+	errors = plugin_errors[0];
+    }
+
+    /* Display the libc results in a compact table */
+    if (run_libc && verbose) {
+	printf("\nResults for libc malloc:\n");
+	printresults(num_tracefiles, libc_stats);
     }
 
     /* Display the mm results in a compact table */
@@ -282,40 +757,58 @@ int main(int argc, char **argv)
 	printf("\nResults for mm malloc:\n");
 	printresults(num_tracefiles, mm_stats);
 	printf("\n");
+	printcopy(num_tracefiles, mm_stats);
     }
 
+    /* Display the utilization over time next to the end-of-trace one */
+    if (util_every)
+	printutil(num_tracefiles, mm_stats);
+
+    /* Display the spread of the timings, and how stable the CPUs were */
+    if (stable)
+	printstable(num_tracefiles, mm_stats, cpus, ncpus, jobs);
+
+    /* Display the hardware events per request */
+    if (counters)
+	printevents(num_tracefiles, mm_stats);
+
+    /* Display the cold heap timings next to the warm ones (not with -S) */
+    if (cold_heap && !stream)
+	printcold(num_tracefiles, mm_stats);
+
+    /* Display the cold cache timings next to the warm ones */
+    if (cold_cache)
+	printcache(num_tracefiles, mm_stats);
+
+    /* Display how much of the time the replay itself takes */
+    if (net)
+	printharness(num_tracefiles, mm_stats);
+
+    /* Display the -m packages side by side */
+    if (nplugins > 1)
+	printplugins(num_tracefiles, plugin_files, plugin_stats, 
+		     plugin_errors, nplugins);
+
     /* 
-     * Accumulate the aggregate statistics for the student's mm package 
+     * Compute and print the performance index 
      */
-    secs = 0;
-    ops = 0;
-    util = 0;
     numcorrect = 0;
-    for (i=0; i < num_tracefiles; i++) {
-	secs += mm_stats[i].secs;
-	ops += mm_stats[i].ops;
-	util += mm_stats[i].util;
+    for (i=0; i < num_tracefiles; i++)
 	if (mm_stats[i].valid)
 	    numcorrect++;
+    perfindex = perf_index(num_tracefiles, mm_stats, errors, &p1, &p2);
+    if (quick) {
+	/* Untimed: only the utilization part, and the errors in the status */
+	if (errors == 0)
+	    printf("Util index = %.0f/%.0f (not timed)\n", p1*100, 
+		   UTIL_WEIGHT*100);
+	else
+	    printf("Terminated with %d errors\n", errors);
+	if (autograder)
+	    printf("correct:%d\n", numcorrect);
+	exit(errors ? 1 : 0);
     }
-    avg_mm_util = util/num_tracefiles;
-
-    /* 
-     * Compute and print the performance index 
-     */
     if (errors == 0) {
-	avg_mm_throughput = ops/secs;
-
-	p1 = UTIL_WEIGHT * avg_mm_util;
-	if (avg_mm_throughput > AVG_LIBC_THRUPUT) {
-	    p2 = (double)(1.0 - UTIL_WEIGHT);
-	} 
-	else {
-	    p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
-		(avg_mm_throughput/AVG_LIBC_THRUPUT);
-	}
-	
-	perfindex = (p1 + p2)*100.0;
 	printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
 	       p1*100, 
 	       p2*100, 
@@ -323,7 +816,6 @@ int main(int argc, char **argv)
 	
     }
     else { /* There were errors */
-	perfindex = 0.0;
 	printf("Terminated with %d errors\n", errors);
     }
 
@@ -332,214 +824,878 @@ int main(int argc, char **argv)
 	printf("perfidx:%.0f\n", perfindex);
     }
 
-    exit(0);
+    /* Write the machine-readable results */
+    if (out) {
+	if (strcmp(outfmt, "json") == 0)
+	    printjson(out, tracefiles, num_tracefiles, libc_stats, mm_stats,
+		      perfindex);
+	else
+	    printcsv(out, tracefiles, num_tracefiles, libc_stats, mm_stats,
+		     perfindex);
+	fclose(out);
+    }
+
+    /* Compare the timings to the baseline's, trace by trace */
+    if (baseline)
+	regressed = compare_baseline(baseline, tracefiles, num_tracefiles,
+				     mm_stats);
+
+    exit(regressed ? 1 : 0);
 }
 
 
 /*****************************************************************
- * The following routines manipulate the range list, which keeps 
- * track of the extent of every allocated block payload. We use the 
- * range list to detect any overlapping allocated blocks.
+ * The following routines evaluate the traces, either one after the
+ * other in this process, or in parallel in forked children (-j).
  ****************************************************************/
 
 /*
- * add_range - As directed by request opnum in trace tracenum,
- *     we've just called the student's mm_malloc to allocate a block of 
- *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list. 
+ * eval_libc_trace - Evaluate the libc malloc package on one trace 
+ *     using the K-best scheme
  */
-static int add_range(range_t **ranges, char *lo, int size, 
-		     int tracenum, int opnum)
+static void eval_libc_trace(char *filename, int tracenum, stats_t *stats)
 {
-    char *hi = lo + size - 1;
-    range_t *p;
-    char msg[MAXLINE];
-
-    assert(size > 0);
+    trace_t *trace;
+    speed_t speed_params;
 
-    /* Payload addresses must be ALIGNMENT-byte aligned */
-    if (!IS_ALIGNED(lo)) {
-	sprintf(msg, "Payload address (%p) not aligned to %d bytes", 
-		lo, ALIGNMENT);
-        malloc_error(tracenum, opnum, msg);
-        return 0;
+    trace = read_trace(tracedir, filename);
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking libc malloc for correctness, ");
+    stats->valid = eval_libc_valid(trace, tracenum);
+    if (stats->valid) {
+	speed_params.trace = trace;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	if (nthreads > 1)
+	    stats->secs = eval_threads(trace, tracenum, 1, stats);
+	else
+	    stats->secs = time_trace(eval_libc_speed, &speed_params, stats);
     }
+    free_trace(trace);
+}
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
-	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
-		lo, hi, mem_heap_lo(), mem_heap_hi());
-	malloc_error(tracenum, opnum, msg);
-        return 0;
+/*
+ * eval_mm_trace - Evaluate the student's mm malloc package on one trace
+ *     using the K-best scheme
+ */
+static void eval_mm_trace(char *filename, int tracenum, stats_t *stats)
+{
+    trace_t *trace;
+    range_t *ranges = NULL;  /* keeps track of block extents */
+    speed_t speed_params;
+    char path[MAXLINE];
+
+    if (stream) {
+	if (verbose > 1)
+	    printf("Streaming %s through mm malloc.\n", filename);
+	strcpy(path, tracedir);
+	strcat(path, filename);
+	if (prefault)
+	    mem_prefault();
+	eval_mm_stream(path, stats);
+	return;
     }
 
-    /* The payload must not overlap any other payloads */
-    for (p = *ranges;  p != NULL;  p = p->next) {
-        if ((lo >= p->lo && lo <= p-> hi) ||
-            (hi >= p->lo && hi <= p->hi)) {
-	    sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-		    lo, hi, p->lo, p->hi);
-	    malloc_error(tracenum, opnum, msg);
-	    return 0;
-        }
+    trace = read_trace(tracedir, filename);
+    stats->ops = trace->num_ops;
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, efficiency%s",
+	       quick ? ".\n" : ", ");
+    stats->valid = eval_mm_check(trace, tracenum, &ranges, stats);
+    if (stats->valid && !quick) {
+	speed_params.trace = trace;
+	speed_params.ranges = ranges;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	if (prefault)
+	    mem_prefault();
+	if (nthreads > 1)
+	    stats->secs = eval_threads(trace, tracenum, 0, stats);
+	else
+	    stats->secs = time_trace(eval_mm_speed, &speed_params, stats);
+
+	/* Time the replay on the null allocators, to subtract it (-z) */
+	if (net) {
+	    if (verbose > 1)
+		printf("Timing the replay on the null allocators.\n");
+	    time_harness(&speed_params, stats);
+	}
+
+	/* Count the hardware events in one more run, outside the timing */
+	if (counters) {
+	    if (verbose > 1)
+		printf("Counting hardware events in mm malloc.\n");
+	    count_trace(eval_mm_speed, &speed_params, stats);
+	}
+
+	/* 
+	 * Time the trace again, but give the heap pages back to the
+	 * kernel before every run, so each run pays for its page faults
+	 */
+	if (cold_heap) {
+	    if (verbose > 1)
+		printf("Timing mm malloc on a cold heap.\n");
+	    stats->cold_secs = fsecs_prep(eval_mm_speed, discard_heap,
+					  &speed_params);
+	}
+
+	/* 
+	 * Time the trace again, evicting the caches before every run, as
+	 * in a program that allocates after a long stretch of other work
+	 */
+	if (cold_cache) {
+	    if (verbose > 1)
+		printf("Timing mm malloc on cold caches.\n");
+	    stats->evict_secs = fsecs_prep(eval_mm_speed, evict_cache,
+					   &speed_params);
+	}
+
+	/* Time every request on its own, for the latency percentiles */
+	if (latency) {
+	    if (verbose > 1)
+		printf("Timing each mm malloc request.\n");
+	    eval_mm_latency(trace, &latencies[tracenum]);
+	}
     }
+    clear_ranges(&ranges);
+    free_trace(trace);
+}
 
-    /* 
-     * Everything looks OK, so remember the extent of this block 
-     * by creating a range struct and adding it the range list.
-     */
-    if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
-	unix_error("malloc error in add_range");
-    p->next = *ranges;
-    p->lo = lo;
-    p->hi = hi;
-    *ranges = p;
-    return 1;
+/*
+ * time_trace - Return the running time of f(argp) using the K-best
+ *     scheme or, with -n, the median of nsamples runs timed one at a
+ *     time after warmup untimed ones, which are kept in stats for 
+ *     -o json, -b and -R
+ */
+static double time_trace(fsecs_test_funct f, void *argp, stats_t *stats)
+{
+    int i;
+
+    if (nsamples == 0)
+	return fsecs(f, argp);
+    for (i = 0; i < warmup; i++)
+	f(argp);  /* warm up the caches, the heap and the branch predictors */
+    ftimer_samples(f, argp, stats->samples, nsamples);
+    stats->nsamples = nsamples;
+    return sample_median(stats->samples, nsamples);
 }
 
-/* 
- * remove_range - Free the range record of block whose payload starts at lo 
+/*
+ * count_trace - Count the hardware events in one run of f(argp), after
+ *     a run to warm up the caches and the heap. The counters are
+ *     opened here, rather than once in main, because they count only
+ *     the thread that opens them and -j runs traces in children.
  */
-static void remove_range(range_t **ranges, char *lo)
+static void count_trace(fsecs_test_funct f, void *argp, stats_t *stats)
 {
-    range_t *p;
-    range_t **prevpp = ranges;
-    // int size;
+    int i;
 
-    for (p = *ranges;  p != NULL; p = p->next) {
-        if (p->lo == lo) {
-	    *prevpp = p->next;
-            // size = p->hi - p->lo + 1;
-            free(p);
-            break;
-        }
-        prevpp = &(p->next);
-    }
+    if (perfctr_open() == 0)
+	return;
+    f(argp);
+    perfctr_start();
+    f(argp);
+    perfctr_stop(stats->events);
+    perfctr_close();
+    for (i = 0; i < PC_NEVENTS; i++)
+	if (stats->events[i] >= 0)
+	    stats->counted = 1;
 }
 
 /*
- * clear_ranges - free all of the range records for a trace 
+ * eval_parallel - Evaluate every trace in a child of its own, running
+ *     up to jobs children at once. Each child has a private copy of the
+ *     simulated heap and writes its result_t to a pipe of its own. With
+ *     ncpus > 0, the child in slot k runs on cpus[k % ncpus], so that
+ *     children running at the same time don't share a core if there 
+ *     are enough CPUs. Children that die are counted as errors. libc
+ *     is evaluated as well unless libc_stats is NULL.
  */
-static void clear_ranges(range_t **ranges)
+static void eval_parallel(char **tracefiles, int num_tracefiles, int jobs,
+			  int *cpus, int ncpus, stats_t *libc_stats, 
+			  stats_t *mm_stats)
 {
-    range_t *p;
-    range_t *pnext;
+    pid_t *pids;     /* child running in each slot, 0 if none */
+    int *fds;        /* read end of that child's pipe */
+    int *traces;     /* and the trace it is evaluating */
+    int i, k, next = 0, running = 0, status;
+    int fd[2];
+    pid_t pid;
+    result_t res;
+    cpu_set_t set;
+
+    if ((pids = (pid_t *)calloc(jobs, sizeof(pid_t))) == NULL ||
+	(fds = (int *)calloc(jobs, sizeof(int))) == NULL ||
+	(traces = (int *)calloc(jobs, sizeof(int))) == NULL)
+	unix_error("calloc failed in eval_parallel");
+
+    while (next < num_tracefiles || running > 0) {
+	/* Start a child in every free slot while traces remain */
+	for (k = 0; k < jobs && next < num_tracefiles; k++) {
+	    if (pids[k] != 0)
+		continue;
+	    if (pipe(fd) < 0)
+		unix_error("pipe failed in eval_parallel");
+	    fflush(stdout);
+	    if ((pid = fork()) < 0)
+		unix_error("fork failed in eval_parallel");
+	    if (pid == 0) {
+		close(fd[0]);
+		if (ncpus > 0) {
+		    CPU_ZERO(&set);
+		    CPU_SET(cpus[k % ncpus], &set);
+		    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+			unix_error("sched_setaffinity failed in eval_parallel");
+		}
+		memset(&res, 0, sizeof(res));
+		res.tracenum = next;
+		if (libc_stats)
+		    eval_libc_trace(tracefiles[next], next, &res.libc);
+		eval_mm_trace(tracefiles[next], next, &res.mm);
+		res.errors = errors;
+		if (latency)
+		    res.latency = latencies[next];
+		if (write(fd[1], &res, sizeof(res)) != sizeof(res))
+		    unix_error("write failed in eval_parallel");
+		exit(0);
+	    }
+	    close(fd[1]);
+	    pids[k] = pid;
+	    fds[k] = fd[0];
+	    traces[k] = next++;
+	    running++;
+	}
 
-    for (p = *ranges;  p != NULL;  p = pnext) {
-        pnext = p->next;
-        free(p);
+	/* Wait for any child and collect its result */
+	if ((pid = wait(&status)) < 0)
+	    unix_error("wait failed in eval_parallel");
+	for (k = 0; k < jobs && pids[k] != pid; k++)
+	    ;
+	if (k == jobs)
+	    continue;
+	i = traces[k];
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+	    read(fds[k], &res, sizeof(res)) == sizeof(res)) {
+	    if (libc_stats)
+		libc_stats[i] = res.libc;
+	    mm_stats[i] = res.mm;
+	    errors += res.errors;
+	    if (latency)
+		latencies[i] = res.latency;
+	}
+	else {
+	    printf("ERROR: the child evaluating trace %d failed\n", i);
+	    mm_stats[i].valid = 0;
+	    errors++;
+	}
+	close(fds[k]);
+	pids[k] = 0;
+	running--;
     }
-    *ranges = NULL;
+    free(pids);
+    free(fds);
+    free(traces);
 }
 
-
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
+/*
+ * pin_driver - Pin the driver to one CPU for -R: the first -p CPU if
+ *     it runs the traces itself, and otherwise the CPU it is on. With 
+ *     -j the children are pinned to the -p CPUs instead.
+ */
+static void pin_driver(int *cpus, int ncpus, int jobs)
+{
+    cpu_set_t set;
+
+    if (jobs > 1)
+	return;
+    stable_cpu = ncpus > 0 ? cpus[0] : sched_getcpu();
+    if (stable_cpu < 0)
+	unix_error("sched_getcpu failed in pin_driver");
+    CPU_ZERO(&set);
+    CPU_SET(stable_cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+	unix_error("sched_setaffinity failed in pin_driver");
+}
 
 /*
- * read_trace - read a trace file and store it in memory
+ * cpu_governor - Put the cpufreq governor of cpu in buf, or "unknown"
+ *     if the kernel doesn't say (no cpufreq, as in most VMs)
  */
-static trace_t *read_trace(char *tracedir, char *filename)
+static void cpu_governor(int cpu, char *buf, int len)
 {
-    FILE *tracefile;
-    trace_t *trace;
-    char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
+    FILE *fp;
+
+    sprintf(path, "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor",
+	    cpu);
+    strncpy(buf, "unknown", len);
+    if ((fp = fopen(path, "r")) == NULL)
+	return;
+    if (fgets(buf, len, fp) == NULL)
+	strncpy(buf, "unknown", len);
+    buf[strcspn(buf, "\n")] = '\0';
+    fclose(fp);
+}
 
-    if (verbose > 1)
-	printf("Reading tracefile: %s\n", filename);
+/*
+ * cpu_turbo - Return 1 if turbo boost is on, 0 if it is off, and -1
+ *     if the kernel doesn't say
+ */
+static int cpu_turbo(void)
+{
+    FILE *fp;
+    int x = -1;
 
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-	unix_error("malloc 1 failed in read_trance");
-	
-    /* Read the trace file header */
-    strcpy(path, tracedir);
-    strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
-	sprintf(msg, "Could not open %s in read_trace", path);
-	unix_error(msg);
+    if ((fp = fopen("/sys/devices/system/cpu/intel_pstate/no_turbo", "r"))) {
+	if (fscanf(fp, "%d", &x) == 1)
+	    x = !x;
+	fclose(fp);
     }
+    else if ((fp = fopen("/sys/devices/system/cpu/cpufreq/boost", "r"))) {
+	if (fscanf(fp, "%d", &x) != 1)
+	    x = -1;
+	fclose(fp);
+    }
+    return x;
+}
 
-    int n_inputs;
-    n_inputs = fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    n_inputs = fscanf(tracefile, "%d", &(trace->num_ids));     
-    n_inputs = fscanf(tracefile, "%d", &(trace->num_ops));     
-    n_inputs = fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-    // Ignore n_inputs
-    // if(n_inputs != 1)
-    //     exit(EXIT_FAILURE);
-
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops = 
-	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-	unix_error("malloc 2 failed in read_trace");
+/*
+ * load_plugin - Load the package that the shared object at path 
+ *     exports as mm_plugin. A path without a slash is taken relative
+ *     to the current directory, not looked up like a library.
+ */
+static mm_plugin_t *load_plugin(char *path)
+{
+    char name[MAXLINE];
+    void *handle;
+    mm_plugin_t *p;
+
+    snprintf(name, MAXLINE, "%s%s", strchr(path, '/') ? "" : "./", path);
+    if ((handle = dlopen(name, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+	fprintf(stderr, "mdriver: %s\n", dlerror());
+	exit(1);
+    }
+    if ((p = (mm_plugin_t *)dlsym(handle, "mm_plugin")) == NULL) {
+	fprintf(stderr, "mdriver: %s doesn't export mm_plugin\n", path);
+	exit(1);
+    }
+    if (!p->init || !p->malloc || !p->free || !p->realloc || 
+	(!p->galloc + !p->grow + !p->gfree) % 3) {
+	fprintf(stderr, "mdriver: %s lacks init, malloc, free or realloc, "
+		"or has only some of galloc, grow and gfree\n", path);
+	exit(1);
+    }
+    if (verbose > 1)
+	printf("Loaded %s from %s\n", p->name, path);
+    return p;
+}
 
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks = 
-	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-	unix_error("malloc 3 failed in read_trace");
+/*
+ * parse_cpus - Turn a CPU list such as "2-5,8" into an array. Returns
+ *     the number of CPUs, or -1 if the list is malformed.
+ */
+static int parse_cpus(char *list, int **cpus)
+{
+    int n = 0, lo, hi, len;
+    char *p = list;
+
+    while (*p) {
+	if (sscanf(p, "%d%n", &lo, &len) != 1 || lo < 0)
+	    return -1;
+	p += len;
+	hi = lo;
+	if (*p == '-') {
+	    p++;
+	    if (sscanf(p, "%d%n", &hi, &len) != 1 || hi < lo)
+		return -1;
+	    p += len;
+	}
+	if ((*cpus = (int *)realloc(*cpus, (n + hi - lo + 1) * sizeof(int)))
+	    == NULL)
+	    unix_error("realloc failed in parse_cpus");
+	for (; lo <= hi; lo++)
+	    (*cpus)[n++] = lo;
+	if (*p == ',')
+	    p++;
+	else if (*p != '\0')
+	    return -1;
+    }
+    return n > 0 ? n : -1;
+}
 
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes = 
-	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-	unix_error("malloc 4 failed in read_trace");
-    
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-	switch(type[0]) {
-	case 'a':
-	    n_inputs = fscanf(tracefile, "%u %u", &index, &size);
-	    if(n_inputs != 2) fprintf(stderr, "option '%c' expect 2 more arguments", type[0]);
-	    trace->ops[op_index].type = ALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
+
+/*****************************************************************
+ * The following routines replay one trace on nthreads threads at once
+ * (-T), through the mm package or libc malloc. Each thread replays 
+ * either a full copy of the trace, or with -s only the requests whose
+ * id it owns (id % nthreads). The mm package serializes the threads 
+ * with mem_lock.
+ ****************************************************************/
+
+/*
+ * eval_threads - Time the threaded replay of trace using the K-best 
+ *     scheme, set stats->ops to the requests issued by all threads, and
+ *     return the wall time of a run. With -v, also print each thread's
+ *     requests and fastest run.
+ */
+static double eval_threads(trace_t *trace, int tracenum, int libc, 
+			   stats_t *stats)
+{
+    replay_t *r;
+    double secs;
+    int i, t;
+
+    if ((r = (replay_t *)calloc(nthreads, sizeof(replay_t))) == NULL)
+	unix_error("calloc failed in eval_threads");
+    stats->ops = 0;
+    for (t = 0; t < nthreads; t++) {
+	r[t].trace = trace;
+	r[t].libc = libc;
+	r[t].id = t;
+	r[t].best = DBL_MAX;
+	if ((r[t].blocks = (char **)malloc(trace->num_ids * sizeof(char *)))
+	    == NULL)
+	    unix_error("malloc failed in eval_threads");
+	for (i = 0; i < trace->num_ops; i++)
+	    if (!shard || trace->ops[i].index % nthreads == t)
+		r[t].ops++;
+	stats->ops += r[t].ops;
+    }
+
+    if (!libc)
+	mem_set_threaded(1);
+    secs = time_trace(eval_threads_speed, r, stats);
+    if (!libc)
+	mem_set_threaded(0);
+
+    if (verbose) {
+	printf("Trace %d on %d threads (%s malloc, %s):\n", tracenum, 
+	       nthreads, libc ? "libc" : "mm", shard ? "sharded by id" : "copies");
+	printf("%6s%10s%10s%8s\n", "thread", "ops", "secs", "Kops");
+	for (t = 0; t < nthreads; t++)
+	    printf("%6d%10.0f%10.6f%8.0f\n", t, r[t].ops, r[t].best,
+		   (r[t].ops/1e3)/r[t].best);
+	printf("%6s%10.0f%10.6f%8.0f\n", "all", stats->ops, secs,
+	       (stats->ops/1e3)/secs);
+    }
+    for (t = 0; t < nthreads; t++)
+	free(r[t].blocks);
+    free(r);
+    return secs;
+}
+
+/*
+ * eval_threads_speed - This is the function that fsecs() times in -T
+ *     mode: one run of every replay thread, started together
+ */
+static void eval_threads_speed(void *ptr)
+{
+    replay_t *r = (replay_t *)ptr;
+    pthread_barrier_t start;
+    int t;
+
+    /* Reset the heap and initialize the mm package */
+    if (!r[0].libc) {
+	mem_reset_brk();
+	if (mm->init() < 0) 
+	    app_error("mm_init failed in eval_threads_speed");
+    }
+
+    pthread_barrier_init(&start, NULL, nthreads);
+    for (t = 0; t < nthreads; t++) {
+	r[t].start = &start;
+	if ((errno = pthread_create(&r[t].tid, NULL, replay_thread, &r[t])))
+	    unix_error("pthread_create failed in eval_threads_speed");
+    }
+    for (t = 0; t < nthreads; t++) {
+	pthread_join(r[t].tid, NULL);
+	if (r[t].secs < r[t].best)
+	    r[t].best = r[t].secs;
+    }
+    pthread_barrier_destroy(&start);
+}
+
+/*
+ * replay_thread - Body of a replay thread. Waits for the others, then
+ *     interprets its share of the trace requests and times itself.
+ */
+static void *replay_thread(void *ptr)
+{
+    replay_t *r = (replay_t *)ptr;
+    trace_t *trace = r->trace;
+    traceop_t *op;
+    struct timeval start, end;
+    int i;
+    char *p;
+
+    pthread_barrier_wait(r->start);
+    gettimeofday(&start, NULL);
+    for (i = 0;  i < trace->num_ops;  i++) {
+	op = &trace->ops[i];
+	if (shard && op->index % nthreads != r->id)
+	    continue;
+        switch (op->type) {
+
+        case ALLOC: /* malloc */
+        case GALLOC: /* mm_galloc */
+	    if (r->libc)
+		p = malloc(op->size);
+	    else if (op->type == GALLOC)
+		p = mm->galloc(op->size, GROW_RESERVE);
+	    else
+		p = mm->malloc(op->size);
+	    if (p == NULL)
+		app_error("malloc failed in replay_thread");
+	    r->blocks[op->index] = p;
 	    break;
-	case 'r':
-	    n_inputs = fscanf(tracefile, "%u %u", &index, &size);
-	    if(n_inputs != 2) fprintf(stderr, "option '%c' expect 2 more arguments", type[0]);
-	    trace->ops[op_index].type = REALLOC;
-	    trace->ops[op_index].index = index;
-	    trace->ops[op_index].size = size;
-	    max_index = (index > max_index) ? index : max_index;
+
+	case REALLOC: /* realloc */
+	    if (r->libc)
+		p = realloc(r->blocks[op->index], op->size);
+	    else
+		p = mm->realloc(r->blocks[op->index], op->size);
+	    if (p == NULL)
+		app_error("realloc failed in replay_thread");
+	    r->blocks[op->index] = p;
+	    break;
+
+	case GROW: /* mm_grow */
+	    if (r->libc) {
+		if ((p = realloc(r->blocks[op->index], op->size)) == NULL)
+		    app_error("realloc failed in replay_thread");
+		r->blocks[op->index] = p;
+	    }
+	    else if (mm->grow(r->blocks[op->index], op->size) < 0)
+		app_error("mm_grow failed in replay_thread");
 	    break;
-	case 'f':
-	    n_inputs = fscanf(tracefile, "%ud", &index);
-	    if(n_inputs != 1) fprintf(stderr, "option '%c' expect 1 more arguments", type[0]);
-	    trace->ops[op_index].type = FREE;
-	    trace->ops[op_index].index = index;
+
+        case FREE: /* free */
+        case GFREE: /* mm_gfree */
+	    if (r->libc)
+		free(r->blocks[op->index]);
+	    else if (op->type == GFREE)
+		mm->gfree(r->blocks[op->index]);
+	    else
+		mm->free(r->blocks[op->index]);
 	    break;
+
 	default:
-	    printf("Bogus type character (%c) in tracefile %s\n", 
-		   type[0], path);
-	    exit(1);
+	    app_error("Nonexistent request type in replay_thread");
 	}
-	op_index++;
+    }
+    gettimeofday(&end, NULL);
+    r->secs = (end.tv_sec - start.tv_sec) + 1E-6*(end.tv_usec - start.tv_usec);
+    return NULL;
+}
+
+
+/*****************************************************************
+ * The following routines manipulate the range tree, which keeps 
+ * track of the extent of every allocated block payload. We use the 
+ * range tree to detect any overlapping allocated blocks. It is an AVL
+ * tree keyed by the low payload address, so checking, adding and 
+ * removing a range are all O(log n) in the number of live blocks.
+ * Records come from a pool that is refilled RANGE_CHUNK at a time and
+ * never returned to malloc.
+ ****************************************************************/
+
+static range_t *range_pool = NULL; /* free range records */
+
+/*
+ * range_height - height of a subtree, 0 if it is empty
+ */
+static int range_height(range_t *p)
+{
+    return p ? p->height : 0;
+}
+
+/*
+ * range_fix - recompute the height of p from its children
+ */
+static void range_fix(range_t *p)
+{
+    int l = range_height(p->left), r = range_height(p->right);
+
+    p->height = 1 + (l > r ? l : r);
+}
+
+/*
+ * range_rotate - rotate p's left (dir 0) or right (dir 1) child up to 
+ *     its place, and return the child
+ */
+static range_t *range_rotate(range_t *p, int dir)
+{
+    range_t *q;
+
+    if (dir == 0) {
+	q = p->left;
+	p->left = q->right;
+	q->right = p;
+    }
+    else {
+	q = p->right;
+	p->right = q->left;
+	q->left = p;
+    }
+    range_fix(p);
+    range_fix(q);
+    return q;
+}
+
+/*
+ * range_balance - restore the AVL property at p after one of its 
+ *     subtrees changed height by one, and return the new subtree root
+ */
+static range_t *range_balance(range_t *p)
+{
+    int diff = range_height(p->left) - range_height(p->right);
+
+    if (diff > 1) {
+	if (range_height(p->left->left) < range_height(p->left->right))
+	    p->left = range_rotate(p->left, 1);
+	return range_rotate(p, 0);
+    }
+    if (diff < -1) {
+	if (range_height(p->right->right) < range_height(p->right->left))
+	    p->right = range_rotate(p->right, 0);
+	return range_rotate(p, 1);
+    }
+    range_fix(p);
+    return p;
+}
+
+/*
+ * range_insert - add record r to the subtree rooted at p
+ */
+static range_t *range_insert(range_t *p, range_t *r)
+{
+    if (p == NULL)
+	return r;
+    if (r->lo < p->lo)
+	p->left = range_insert(p->left, r);
+    else
+	p->right = range_insert(p->right, r);
+    return range_balance(p);
+}
+
+/*
+ * range_delete - unlink the record that starts at lo from the subtree
+ *     rooted at p, and store it in *found (NULL if there is none)
+ */
+static range_t *range_delete(range_t *p, char *lo, range_t **found)
+{
+    range_t *succ;
+
+    if (p == NULL) {
+	*found = NULL;
+	return NULL;
+    }
+    if (lo < p->lo)
+	p->left = range_delete(p->left, lo, found);
+    else if (lo > p->lo)
+	p->right = range_delete(p->right, lo, found);
+    else {
+	*found = p;
+	if (p->left == NULL || p->right == NULL)
+	    return p->left ? p->left : p->right;
+	/* Replace p by its successor, the leftmost range on its right */
+	for (succ = p->right; succ->left != NULL; succ = succ->left)
+	    ;
+	p->right = range_delete(p->right, succ->lo, &succ);
+	succ->left = p->left;
+	succ->right = p->right;
+	p = succ;
+    }
+    return range_balance(p);
+}
+
+/*
+ * range_release - return every record in the subtree at p to the pool
+ */
+static void range_release(range_t *p)
+{
+    if (p == NULL)
+	return;
+    range_release(p->left);
+    range_release(p->right);
+    p->left = range_pool;
+    range_pool = p;
+}
+
+/*
+ * add_range - As directed by request opnum in trace tracenum,
+ *     we've just called the student's mm_malloc to allocate a block of 
+ *     size bytes at addr lo. After checking the block for correctness,
+ *     we create a range struct for this block and add it to the range tree. 
+ */
+static int add_range(range_t **ranges, char *lo, int size, 
+		     int tracenum, int opnum)
+{
+    char *hi = lo + size - 1;
+    range_t *p, *below;
+    char msg[MAXLINE];
+    int i;
+
+    assert(size > 0);
+
+    /* Payload addresses must be ALIGNMENT-byte aligned */
+    if (!IS_ALIGNED(lo)) {
+	sprintf(msg, "Payload address (%p) not aligned to %d bytes", 
+		lo, ALIGNMENT);
+        malloc_error(tracenum, opnum, msg);
+        return 0;
+    }
+
+    /* 
+     * The payload must lie within the extent of the heap, or within 
+     * an address range the package reserved for it 
+     */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_in_map(lo, hi)) {
+	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
+		lo, hi, mem_heap_lo(), mem_heap_hi());
+	malloc_error(tracenum, opnum, msg);
+        return 0;
+    }
+
+    /* 
+     * The payload must not overlap any other payloads. Since the 
+     * recorded payloads are disjoint, it is enough to check the one
+     * with the highest lo that is still <= hi.
+     */
+    below = NULL;
+    for (p = *ranges;  p != NULL; )  {
+	if (p->lo <= hi) {
+	    below = p;
+	    p = p->right;
+	}
+	else
+	    p = p->left;
+    }
+    if (below != NULL && below->hi >= lo) {
+	sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+		lo, hi, below->lo, below->hi);
+	malloc_error(tracenum, opnum, msg);
+	return 0;
+    }
+
+    /* 
+     * Everything looks OK, so remember the extent of this block 
+     * by taking a range struct from the pool and adding it the tree.
+     */
+    if (range_pool == NULL) {
+	if ((p = (range_t *)malloc(RANGE_CHUNK * sizeof(range_t))) == NULL)
+	    unix_error("malloc error in add_range");
+	for (i = 0; i < RANGE_CHUNK; i++) {
+	    p[i].left = range_pool;
+	    range_pool = &p[i];
+	}
+    }
+    p = range_pool;
+    range_pool = p->left;
+    p->lo = lo;
+    p->hi = hi;
+    p->left = p->right = NULL;
+    p->height = 1;
+    *ranges = range_insert(*ranges, p);
+    return 1;
+}
+
+/* 
+ * remove_range - Free the range record of block whose payload starts at lo 
+ */
+static void remove_range(range_t **ranges, char *lo)
+{
+    range_t *p;
+
+    *ranges = range_delete(*ranges, lo, &p);
+    if (p != NULL) {
+	p->left = range_pool;
+	range_pool = p;
+    }
+}
+
+/*
+ * clear_ranges - free all of the range records for a trace 
+ */
+static void clear_ranges(range_t **ranges)
+{
+    range_release(*ranges);
+    *ranges = NULL;
+}
+
+
+/**********************************************
+ * The following routines manipulate tracefiles
+ *********************************************/
+
+/*
+ * read_trace - read a trace file and store it in memory. tf_read 
+ *     detects binary traces (see rep2bin) and maps them instead.
+ */
+static trace_t *read_trace(char *tracedir, char *filename)
+{
+    trace_t *trace;
+    char path[MAXLINE];
+    int i;
+
+    if (verbose > 1)
+	printf("Reading tracefile: %s\n", filename);
+
+    /* Allocate the trace record */
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+	unix_error("malloc 1 failed in read_trance");
 	
+    /* Read the header and every request in the trace file */
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    trace->tf = tf_read(path);
+    trace->sugg_heapsize = trace->tf->sugg_heapsize; /* not used */
+    trace->num_ids = trace->tf->num_ids;
+    trace->num_ops = trace->tf->num_ops;
+    trace->weight = trace->tf->weight;               /* not used */
+    trace->ops = trace->tf->ops;
+
+    /* Split the requests into one array per field for the timed replays */
+    if ((trace->op_types = 
+	 (unsigned char *)malloc(trace->num_ops)) == NULL ||
+	(trace->op_ids = 
+	 (int32_t *)malloc(trace->num_ops * sizeof(int32_t))) == NULL ||
+	(trace->op_sizes = 
+	 (int32_t *)malloc(trace->num_ops * sizeof(int32_t))) == NULL)
+	unix_error("malloc 4 failed in read_trace");
+    for (i = 0; i < trace->num_ops; i++) {
+	trace->op_types[i] = trace->ops[i].type;
+	trace->op_ids[i] = trace->ops[i].index;
+	trace->op_sizes[i] = trace->ops[i].size;
     }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
-    
+
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks = 
+	 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	unix_error("malloc 2 failed in read_trace");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes = 
+	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	unix_error("malloc 3 failed in read_trace");
+
     return trace;
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * free_trace - Free the trace record, the arrays allocated in 
+ *              read_trace(), and the trace file's requests.
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);      
+    tf_free(trace->tf);       /* free the requests... */
+    free(trace->op_types);    /* ... their split copy... */
+    free(trace->op_ids);
+    free(trace->op_sizes);
+    free(trace->blocks);      /* ... the two arrays... */
     free(trace->block_sizes);
     free(trace);              /* and the trace record itself... */
 }
@@ -550,28 +1706,117 @@ void free_trace(trace_t *trace)
  **********************************************************************/
 
 /*
- * eval_mm_valid - Check the mm malloc package for correctness
+ * check_payload - Return 1 if each of the n bytes at p is c. Bytes up
+ *     to a word boundary are compared one by one, the rest four words
+ *     at a time against c repeated in every byte of a word.
  */
-static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
+static int check_payload(char *p, size_t n, unsigned char c)
 {
-    int i, j;
+    uintptr_t pattern = (~(uintptr_t)0 / 0xFF) * c;
+    uintptr_t w[4];
+
+    for (; n > 0 && ((uintptr_t)p & (sizeof(uintptr_t)-1)); p++, n--)
+	if ((unsigned char)*p != c)
+	    return 0;
+    for (; n >= sizeof(w); p += sizeof(w), n -= sizeof(w)) {
+	memcpy(w, p, sizeof(w));
+	if (((w[0] ^ pattern) | (w[1] ^ pattern) | 
+	     (w[2] ^ pattern) | (w[3] ^ pattern)) != 0)
+	    return 0;
+    }
+    for (; n > 0; p++, n--)
+	if ((unsigned char)*p != c)
+	    return 0;
+    return 1;
+}
+
+/*
+ * eval_mm_check - Check the mm malloc package for correctness and 
+ *   evaluate its space utilization, in one replay of the trace.
+ *
+ *   Every block must be aligned, lie in the heap or a mapping, and not
+ *   overlap another (see add_range). Its payload is filled with the low
+ *   byte of its id, and a realloc must keep the old payload's bytes;
+ *   with -k, only the blocks whose id is a multiple of check_every are
+ *   filled and checked.
+ *
+ *   The utilization is the ratio hwm/heapsize, where hwm is the high
+ *   water mark of the payload bytes, which is the heap an optimal 
+ *   allocator (no gaps, no internal fragmentation) would need, and 
+ *   heapsize the size of the heap after running the trace. Note that 
+ *   our implementation of mem_sbrk() doesn't allow the students to 
+ *   decrement the brk pointer, so brk is always the high water mark of 
+ *   the heap. Memory committed to growable blocks outside the heap can
+ *   be given back, so we add the high water mark of that to heapsize.
+ *   
+ *   With -U, that ratio is also sampled every util_every requests, as
+ *   the peak payload so far over the peak footprint so far, and its
+ *   mean over the trace and over the worst window of the trace go in
+ *   stats. A package that bloats early or only catches up late then
+ *   scores lower than its end-of-trace ratio.
+ *
+ *   Along the way we count the payload bytes that reallocs had to copy
+ *   because the block moved, the bytes the package remapped instead of
+ *   copying (see mem_remap), and the bytes growable blocks gained in
+ *   place, and record them in stats.
+ *
+ *   Returns 1 if the package ran the trace correctly, in which case 
+ *   stats->util is set.
+ */
+static int eval_mm_check(trace_t *trace, int tracenum, range_t **ranges,
+			 stats_t *stats)
+{
+    int i;
     int index;
-    int size;
-    int oldsize;
-    char *newp;
-    char *oldp;
+    int size, oldsize;
+    size_t max_total_size = 0; /* can pass 2 GB with mapped blocks */
+    size_t total_size = 0;
+    int valid = 0;
+    size_t footprint = 0;
+    size_t remapped, moved;
     char *p;
-    
-    /* Reset the heap and free any records in the range list */
+    char *newp, *oldp;
+    double *curve = NULL;      /* -U samples of the utilization so far */
+    int nsamples = 0, w, j;
+    double sum;
+    FILE *ms = NULL;           /* the --curve rows of this trace */
+    char *rows;
+    size_t rowlen;
+    int fd;
+
+    stats->copied = 0;
+    stats->remapped = 0;
+    stats->grown = 0;
+
+    /* Reset the heap and free any records in the range tree */
     mem_reset_brk();
     clear_ranges(ranges);
 
+    /* Growable blocks need mm_galloc, which a -m package may not have */
+    if (mm->galloc == NULL) {
+	for (i = 0; i < trace->num_ops; i++) {
+	    if (trace->ops[i].type == GALLOC) {
+		malloc_error(tracenum, i, "the package has no mm_galloc.");
+		return 0;
+	    }
+	}
+    }
+
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (mm->init() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
 
+    if (util_every) {
+	curve = (double *)malloc((trace->num_ops / util_every + 1) * 
+				 sizeof(double));
+	if (curve == NULL)
+	    unix_error("malloc failed in eval_mm_check");
+	if (curve_path && (ms = open_memstream(&rows, &rowlen)) == NULL)
+	    unix_error("open_memstream failed in eval_mm_check");
+    }
+
     /* Interpret each operation in the trace in order */
     for (i = 0;  i < trace->num_ops;  i++) {
 	index = trace->ops[i].index;
@@ -580,227 +1825,567 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
+        case GALLOC: /* mm_galloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    if (trace->ops[i].type == GALLOC)
+		p = mm->galloc(size, GROW_RESERVE);
+	    else
+		p = mm->malloc(size);
+	    if (p == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
-		return 0;
+		goto out;
 	    }
 	    
 	    /* 
 	     * Test the range of the new block for correctness and add it 
-	     * to the range list if OK. The block must be  be aligned properly,
+	     * to the range tree if OK. The block must be  be aligned properly,
 	     * and must not overlap any currently allocated block. 
 	     */ 
 	    if (add_range(ranges, p, size, tracenum, i) == 0)
-		return 0;
+		goto out;
 	    
 	    /* ADDED: cgw
 	     * fill range with low byte of index.  This will be used later
 	     * if we realloc the block and wish to make sure that the old
 	     * data was copied to the new block
 	     */
-	    memset(p, index & 0xFF, size);
+	    if (index % check_every == 0)
+		memset(p, index & 0xFF, size);
 
 	    /* Remember region */
 	    trace->blocks[index] = p;
 	    trace->block_sizes[index] = size;
+
+	    /* Keep track of the payload bytes, and of their peak */
+	    total_size += size;
+	    if (total_size > max_total_size)
+		max_total_size = total_size;
 	    break;
 
         case REALLOC: /* mm_realloc */
+        case GROW: /* mm_grow */
 	    
-	    /* Call the student's realloc */
+	    /* Call the student's realloc; a growable block never moves */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    oldsize = trace->block_sizes[index];
+	    if (trace->ops[i].type == GROW) {
+		newp = (mm->grow(oldp, size) < 0) ? NULL : oldp;
+		if (newp != NULL && size > oldsize)
+		    stats->grown += size - oldsize;
+	    }
+	    else {
+		remapped = mem_remapped();
+		newp = mm->realloc(oldp, size);
+		remapped = mem_remapped() - remapped;
+		stats->remapped += remapped;
+
+		/* Whatever moved and wasn't remapped was copied */
+		moved = (newp == oldp) ? 0 : 
+		    (size < oldsize) ? size : oldsize;
+		if (newp != NULL && moved > remapped)
+		    stats->copied += moved - remapped;
+	    }
+	    if (newp == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
-		return 0;
+		goto out;
 	    }
 	    
-	    /* Remove the old region from the range list */
+	    /* Remove the old region from the range tree */
 	    remove_range(ranges, oldp);
 	    
-	    /* Check new block for correctness and add it to range list */
+	    /* Check new block for correctness and add it to range tree */
 	    if (add_range(ranges, newp, size, tracenum, i) == 0)
-		return 0;
+		goto out;
 	    
 	    /* ADDED: cgw
 	     * Make sure that the new block contains the data from the old 
 	     * block and then fill in the new block with the low order byte
 	     * of the new index
 	     */
-	    oldsize = trace->block_sizes[index];
-	    if (size < oldsize) oldsize = size;
-	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
-		malloc_error(tracenum, i, "mm_realloc did not preserve the "
-			     "data from old block");
-		return 0;
-	      }
+	    if (index % check_every == 0) {
+		if (!check_payload(newp, (size < oldsize) ? size : oldsize,
+				   index & 0xFF)) {
+		    malloc_error(tracenum, i, "mm_realloc did not preserve "
+				 "the data from old block");
+		    goto out;
+		}
+		memset(newp, index & 0xFF, size);
 	    }
-	    memset(newp, index & 0xFF, size);
 
 	    /* Remember region */
 	    trace->blocks[index] = newp;
 	    trace->block_sizes[index] = size;
+
+	    /* Keep track of the payload bytes, and of their peak */
+	    total_size = total_size + size - oldsize;
+	    if (total_size > max_total_size)
+		max_total_size = total_size;
 	    break;
 
         case FREE: /* mm_free */
+        case GFREE: /* mm_gfree */
 	    
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    if (trace->ops[i].type == GFREE)
+		mm->gfree(p);
+	    else
+		mm->free(p);
+	    total_size -= trace->block_sizes[index];
 	    break;
 
 	default:
-	    app_error("Nonexistent request type in eval_mm_valid");
+	    app_error("Nonexistent request type in eval_mm_check");
         }
 
+	/* Let a package with a heap checker check the heap (-V: always) */
+	if (mm->check && (verbose > 1 || i == trace->num_ops-1) && 
+	    !mm->check()) {
+	    malloc_error(tracenum, i, "the heap checker found an error.");
+	    goto out;
+	}
+
+	/* Keep track of the largest footprint of the package */
+	if (mem_heapsize() + mem_mapsize() > footprint)
+	    footprint = mem_heapsize() + mem_mapsize();
+
+	/* Sample the utilization so far (-U) */
+	if (util_every && ((i+1) % util_every == 0 || i == trace->num_ops-1)) {
+	    curve[nsamples++] = footprint ? 
+		(double)max_total_size / footprint : 1;
+	    if (ms) {
+		fprintf(ms, "%d,%d,%lu,%lu,%lu,%lu,", tracenum, i+1, 
+			(unsigned long)total_size, 
+			(unsigned long)max_total_size, 
+			(unsigned long)(mem_heapsize() + mem_mapsize()),
+			(unsigned long)footprint);
+		if (mm->free_bytes)
+		    fprintf(ms, "%lu", (unsigned long)mm->free_bytes());
+		fprintf(ms, ",%.6f\n", curve[nsamples-1]);
+	    }
+	}
     }
 
     /* As far as we know, this is a valid malloc package */
-    return 1;
+    valid = 1;
+    /* An empty trace needs no heap, and wastes none */
+    stats->util = footprint ? 
+	(double)max_total_size / (double)footprint : 1;
+
+    /* 
+     * Average the samples over the trace, and over each window of 
+     * 1/UTIL_WINDOW of it to find the worst one
+     */
+    if (util_every) {
+	w = (nsamples + UTIL_WINDOW - 1) / UTIL_WINDOW;
+	stats->worst_util = 1;
+	for (sum = 0, j = 0; j < nsamples; j++) {
+	    sum += curve[j];
+	    if (j >= w)
+		sum -= curve[j-w];
+	    if (j >= w-1 && sum / w < stats->worst_util)
+		stats->worst_util = sum / w;
+	}
+	for (sum = 0, j = 0; j < nsamples; j++)
+	    sum += curve[j];
+	stats->avg_util = sum / nsamples;
+
+	/* One write, so that -j children don't interleave their rows */
+	if (ms) {
+	    fclose(ms);
+	    ms = NULL;
+	    if ((fd = open(curve_path, O_WRONLY | O_APPEND)) < 0 ||
+		write(fd, rows, rowlen) != (ssize_t)rowlen)
+		unix_error("Could not write the --curve file");
+	    close(fd);
+	    free(rows);
+	}
+    }
+
+ out:
+    if (ms) {
+	fclose(ms);
+	free(rows);
+    }
+    free(curve);
+    return valid;
 }
 
-/* 
- * eval_mm_util - Evaluate the space utilization of the student's package
- *   The idea is to remember the high water mark "hwm" of the heap for 
- *   an optimal allocator, i.e., no gaps and no internal fragmentation.
- *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
- *   
+
+/*
+ * eval_mm_speed - This is the function that is used by fcyc()
+ *    to measure the running time of the mm malloc package. The trace
+ *    and its arrays are loaded into locals, since the compiler has to
+ *    assume that every call into the package changes them.
  */
-static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
-{   
-    int i;
-    int index;
-    int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
+static void eval_mm_speed(void *ptr)
+{
+    int i, n;
+    char *p, *newp;
+    trace_t *trace = ((speed_t *)ptr)->trace;
+    unsigned char *types = trace->op_types;
+    int32_t *ids = trace->op_ids, *sizes = trace->op_sizes;
+    char **blocks = trace->blocks;
+    mm_plugin_t *package = mm;
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (package->init() < 0) 
+	app_error("mm_init failed in eval_mm_speed");
+
+    /* Interpret each trace request */
+    n = trace->num_ops;
+    for (i = 0;  i < n;  i++)
+        switch (types[i]) {
+
+        case ALLOC: /* mm_malloc */
+            if ((p = package->malloc(sizes[i])) == NULL)
+		app_error("mm_malloc error in eval_mm_speed");
+            blocks[ids[i]] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
+            if ((newp = package->realloc(blocks[ids[i]], sizes[i])) == NULL)
+		app_error("mm_realloc error in eval_mm_speed");
+            blocks[ids[i]] = newp;
+            break;
+
+        case FREE: /* mm_free */
+            package->free(blocks[ids[i]]);
+            break;
+
+        case GALLOC: /* mm_galloc */
+            if ((p = package->galloc(sizes[i], GROW_RESERVE)) == NULL)
+		app_error("mm_galloc error in eval_mm_speed");
+            blocks[ids[i]] = p;
+            break;
+
+	case GROW: /* mm_grow */
+            if (package->grow(blocks[ids[i]], sizes[i]) < 0)
+		app_error("mm_grow error in eval_mm_speed");
+            break;
+
+        case GFREE: /* mm_gfree */
+            package->gfree(blocks[ids[i]]);
+            break;
+
+	default:
+	    app_error("Nonexistent request type in eval_mm_speed");
+        }
+}
+
+/*
+ * time_harness - Time the replay itself: the loop, the dispatch on the
+ *    request type, the calls through mm and the blocks[] loads and
+ *    stores. The trace is replayed on the two null allocators with the
+ *    same eval_mm_speed as the package, using fsecs either way.
+ */
+static void time_harness(speed_t *speed_params, stats_t *stats)
+{
+    mm_plugin_t *package = mm;
+
+    mm = &null_bump;
+    stats->bump_secs = fsecs(eval_mm_speed, speed_params);
+    mm = &null_fixed;
+    stats->fixed_secs = fsecs(eval_mm_speed, speed_params);
+    mm = package;
+}
+
+/*
+ * trace_secs - Return the secs of a trace that its throughput is based
+ *    on: with -z, its time less the cheaper null allocator's, since
+ *    neither can take less time than the replay alone. The difference
+ *    of two noisy timings can come out near zero, so it is kept above
+ *    MIN_NET of the raw time.
+ */
+static double trace_secs(stats_t *s)
+{
+    double harness, secs;
+
+    if (!net)
+	return s->secs;
+    harness = s->bump_secs < s->fixed_secs ? s->bump_secs : s->fixed_secs;
+    secs = s->secs - harness;
+    return secs < MIN_NET * s->secs ? MIN_NET * s->secs : secs;
+}
+
+/*
+ * The null allocators (-z). bump hands out the next ALIGNMENT-aligned
+ * address past the last block; fixed always returns the heap's first
+ * address, since it never moves null_brk. Neither touches memory: the
+ * speed replay never looks inside a block, so the addresses needn't be
+ * backed.
+ */
+static uintptr_t null_brk;   /* bump's next address */
+
+static int null_init(void)
+{
+    null_brk = (uintptr_t)mem_heap_lo();
+    return 0;
+}
+
+static void *bump_malloc(size_t size)
+{
+    uintptr_t p = null_brk;
+
+    null_brk += (size + ALIGNMENT-1) & ~(uintptr_t)(ALIGNMENT-1);
+    return (void *)p;
+}
+
+static void *bump_realloc(void *ptr, size_t size)
+{
+    return bump_malloc(size);
+}
+
+static void *bump_galloc(size_t size, size_t maxsize)
+{
+    return bump_malloc(size);
+}
+
+static void *fixed_malloc(size_t size)
+{
+    return (void *)null_brk;
+}
+
+static void *fixed_realloc(void *ptr, size_t size)
+{
+    return (void *)null_brk;
+}
+
+static void *fixed_galloc(size_t size, size_t maxsize)
+{
+    return (void *)null_brk;
+}
+
+static void null_free(void *ptr)
+{
+}
+
+static int null_grow(void *ptr, size_t size)
+{
+    return 0;
+}
+
+/*
+ * eval_mm_latency - Replay the trace once more, timing every call into
+ *    the mm package with read_tsc, and keep the latency percentiles of
+ *    each kind of request in lat for printlatency. The overhead of a pair of read_tsc calls is
+ *    subtracted from every sample, so the slow calls that an average 
+ *    over the whole trace hides (long fit searches, big realloc copies)
+ *    show up in the tail.
+ */
+static void eval_mm_latency(trace_t *trace, latency_t *lat)
+{
+    hist_t *h;   /* one histogram for each of the names */
+    unsigned long long ovhd, t0, t1;
+    int i, k, index, size;
     char *p;
-    char *newp, *oldp;
 
-    /* initialize the heap and the mm malloc package */
+    if ((h = (hist_t *)calloc(3, sizeof(hist_t))) == NULL)
+	unix_error("calloc failed in eval_mm_latency");
+    ovhd = tsc_ovhd();
+
+    /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0)
-	app_error("mm_init failed in eval_mm_util");
+    if (mm->init() < 0) 
+	app_error("mm_init failed in eval_mm_latency");
 
     for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+	p = NULL;
         switch (trace->ops[i].type) {
 
-        case ALLOC: /* mm_alloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
+        case ALLOC: /* mm_malloc */
+	    t0 = read_tsc();
+	    p = mm->malloc(size);
+	    t1 = read_tsc();
+	    k = 0;
+	    break;
 
-	    if ((p = mm_malloc(size)) == NULL) 
-		app_error("mm_malloc failed in eval_mm_util");
-	    
-	    /* Remember region and size */
-	    trace->blocks[index] = p;
-	    trace->block_sizes[index] = size;
-	    
-	    /* Keep track of current total size
-	     * of all allocated blocks */
-	    total_size += size;
-	    
-	    /* Update statistics */
-	    max_total_size = (total_size > max_total_size) ?
-		total_size : max_total_size;
+        case GALLOC: /* mm_galloc */
+	    t0 = read_tsc();
+	    p = mm->galloc(size, GROW_RESERVE);
+	    t1 = read_tsc();
+	    k = 0;
 	    break;
 
 	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
-	    oldsize = trace->block_sizes[index];
-
-	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
-		app_error("mm_realloc failed in eval_mm_util");
+	    t0 = read_tsc();
+	    p = mm->realloc(trace->blocks[index], size);
+	    t1 = read_tsc();
+	    k = 2;
+	    break;
 
-	    /* Remember region and size */
-	    trace->blocks[index] = newp;
-	    trace->block_sizes[index] = newsize;
-	    
-	    /* Keep track of current total size
-	     * of all allocated blocks */
-	    total_size += (newsize - oldsize);
-	    
-	    /* Update statistics */
-	    max_total_size = (total_size > max_total_size) ?
-		total_size : max_total_size;
+	case GROW: /* mm_grow */
+	    t0 = read_tsc();
+	    if (mm->grow(trace->blocks[index], size) == 0)
+		p = trace->blocks[index];
+	    t1 = read_tsc();
+	    k = 2;
 	    break;
 
         case FREE: /* mm_free */
-	    index = trace->ops[i].index;
-	    size = trace->block_sizes[index];
-	    p = trace->blocks[index];
-	    
-	    mm_free(p);
-	    
-	    /* Keep track of current total size
-	     * of all allocated blocks */
-	    total_size -= size;
-	    
+	    t0 = read_tsc();
+	    mm->free(trace->blocks[index]);
+	    t1 = read_tsc();
+	    k = 1;
+	    break;
+
+        case GFREE: /* mm_gfree */
+	    t0 = read_tsc();
+	    mm->gfree(trace->blocks[index]);
+	    t1 = read_tsc();
+	    k = 1;
 	    break;
 
 	default:
-	    app_error("Nonexistent request type in eval_mm_util");
-
+	    app_error("Nonexistent request type in eval_mm_latency");
+	    return;
         }
+	if (k != 1) {
+	    if (p == NULL)
+		app_error("mm_malloc failed in eval_mm_latency");
+	    trace->blocks[index] = p;
+	}
+	hist_record(&h[k], (t1 - t0 > ovhd) ? t1 - t0 - ovhd : 0);
+    }
+
+    lat->measured = 1;
+    lat->ovhd = ovhd;
+    for (k = 0; k < 3; k++) {
+	lat->count[k] = h[k].total;
+	lat->p50[k] = hist_percentile(&h[k], 0.5);
+	lat->p99[k] = hist_percentile(&h[k], 0.99);
+	lat->p999[k] = hist_percentile(&h[k], 0.999);
+	lat->max[k] = h[k].max;
     }
+    free(h);
+}
 
-    return ((double)max_total_size / (double)mem_heapsize());
+/*
+ * discard_heap - Called by fsecs_prep() before each timed run of
+ *    eval_mm_speed to make the simulated heap cold again
+ */
+static void discard_heap(void *ptr)
+{
+    mem_discard();
 }
 
+/*
+ * evict_cache - Also called by fsecs_prep before each timed run (-x),
+ *     to leave nothing of the heap or the trace in the caches
+ */
+static void evict_cache(void *ptr)
+{
+    cache_evict();
+}
 
 /*
- * eval_mm_speed - This is the function that is used by fcyc()
- *    to measure the running time of the mm malloc package.
+ * eval_mm_stream - Replay the trace at path through the mm package 
+ *    while a reader thread decodes it chunk by chunk (tf_open), so the
+ *    trace never has to fit in memory. Live blocks are kept in an idmap
+ *    instead of arrays sized by num_ids. A streamed trace can only be
+ *    replayed once, so that one pass yields both the utilization and
+ *    the running time, and payloads are not checked for overlaps; run 
+ *    the trace without -S for that.
  */
-static void eval_mm_speed(void *ptr)
+static void eval_mm_stream(char *path, stats_t *stats)
 {
-    int i, index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
+    stream_t params;
+
+    params.stream = tf_open(path);
+    params.stats = stats;
+    stats->ops = params.stream->num_ops;
+    stats->secs = ftimer_gettod(eval_mm_stream_run, &params, 1);
+    stats->valid = 1;
+    tf_close(params.stream);
+}
+
+/*
+ * eval_mm_stream_run - The streamed replay that eval_mm_stream times
+ */
+static void eval_mm_stream_run(void *ptr)
+{
+    tfstream_t *s = ((stream_t *)ptr)->stream;
+    stats_t *stats = ((stream_t *)ptr)->stats;
+    idmap_t *live = idmap_new(); /* the block and size of every live id */
+    idmap_entry_t *e;
+    traceop_t *ops;
+    int i, n;
+    double total_size = 0, max_total_size = 0;
+    size_t footprint = 0;
+    char *p;
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0) 
-	app_error("mm_init failed in eval_mm_speed");
-
-    /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
-        switch (trace->ops[i].type) {
+    if (mm->init() < 0)
+	app_error("mm_init failed in eval_mm_stream");
+
+    /* Interpret each trace request, one chunk at a time */
+    while ((n = tf_next(s, &ops)) > 0) {
+	for (i = 0; i < n; i++) {
+	    switch (ops[i].type) {
+
+	    case ALLOC: /* mm_malloc */
+	    case GALLOC: /* mm_galloc */
+		if (ops[i].type == GALLOC && mm->galloc == NULL)
+		    app_error("the package has no mm_galloc in eval_mm_stream");
+		if (ops[i].type == GALLOC)
+		    p = mm->galloc(ops[i].size, GROW_RESERVE);
+		else
+		    p = mm->malloc(ops[i].size);
+		if (p == NULL)
+		    app_error("mm_malloc failed in eval_mm_stream");
+		e = idmap_put(live, ops[i].index);
+		e->ptr = p;
+		e->size = ops[i].size;
+		total_size += ops[i].size;
+		break;
 
-        case ALLOC: /* mm_malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
-		app_error("mm_malloc error in eval_mm_speed");
-            trace->blocks[index] = p;
-            break;
+	    case REALLOC: /* mm_realloc */
+	    case GROW: /* mm_grow */
+		if ((e = idmap_get(live, ops[i].index)) == NULL)
+		    app_error("realloc of a free id in eval_mm_stream");
+		if (ops[i].type == GROW) {
+		    if (mm->grow(e->ptr, ops[i].size) < 0)
+			app_error("mm_grow failed in eval_mm_stream");
+		}
+		else if ((p = mm->realloc(e->ptr, ops[i].size)) == NULL)
+		    app_error("mm_realloc failed in eval_mm_stream");
+		else
+		    e->ptr = p;
+		total_size += (double)ops[i].size - e->size;
+		e->size = ops[i].size;
+		break;
 
-	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
-		app_error("mm_realloc error in eval_mm_speed");
-            trace->blocks[index] = newp;
-            break;
+	    case FREE: /* mm_free */
+	    case GFREE: /* mm_gfree */
+		if ((e = idmap_get(live, ops[i].index)) == NULL)
+		    app_error("free of a free id in eval_mm_stream");
+		if (ops[i].type == GFREE)
+		    mm->gfree(e->ptr);
+		else
+		    mm->free(e->ptr);
+		total_size -= e->size;
+		idmap_del(live, ops[i].index);
+		break;
 
-        case FREE: /* mm_free */
-            index = trace->ops[i].index;
-            block = trace->blocks[index];
-            mm_free(block);
-            break;
+	    default:
+		app_error("Nonexistent request type in eval_mm_stream");
+	    }
 
-	default:
-	    app_error("Nonexistent request type in eval_mm_valid");
-        }
+	    /* Keep track of the peak payload and the largest footprint */
+	    if (total_size > max_total_size)
+		max_total_size = total_size;
+	    if (mem_heapsize() + mem_mapsize() > footprint)
+		footprint = mem_heapsize() + mem_mapsize();
+	}
+    }
+    idmap_free(live);
+    stats->util = footprint ? max_total_size / footprint : 1;
 }
 
 /*
@@ -818,6 +2403,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* malloc */
+        case GALLOC: /* libc has no growable blocks */
 	    if ((p = malloc(trace->ops[i].size)) == NULL) {
 		malloc_error(tracenum, i, "libc malloc failed");
 		unix_error("System message");
@@ -826,6 +2412,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    break;
 
 	case REALLOC: /* realloc */
+	case GROW:
             newsize = trace->ops[i].size;
 	    oldp = trace->blocks[trace->ops[i].index];
 	    if ((newp = realloc(oldp, newsize)) == NULL) {
@@ -836,6 +2423,7 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    break;
 	    
         case FREE: /* free */
+        case GFREE:
 	    free(trace->blocks[trace->ops[i].index]);
 	    break;
 
@@ -850,44 +2438,192 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 /* 
  * eval_libc_speed - This is the function that is used by fcyc() to
  *    measure the running time of the libc malloc package on the set
- *    of traces.
+ *    of traces. It reads the trace like eval_mm_speed.
  */
 static void eval_libc_speed(void *ptr)
 {
-    int i;
-    int index, size, newsize;
-    char *p, *newp, *oldp, *block;
+    int i, n;
+    char *p, *newp;
     trace_t *trace = ((speed_t *)ptr)->trace;
+    unsigned char *types = trace->op_types;
+    int32_t *ids = trace->op_ids, *sizes = trace->op_sizes;
+    char **blocks = trace->blocks;
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
+    n = trace->num_ops;
+    for (i = 0;  i < n;  i++) {
+        switch (types[i]) {
         case ALLOC: /* malloc */
-	    index = trace->ops[i].index;
-	    size = trace->ops[i].size;
-	    if ((p = malloc(size)) == NULL)
+        case GALLOC: /* libc has no growable blocks */
+	    if ((p = malloc(sizes[i])) == NULL)
 		unix_error("malloc failed in eval_libc_speed");
-	    trace->blocks[index] = p;
+	    blocks[ids[i]] = p;
 	    break;
 
 	case REALLOC: /* realloc */
-	    index = trace->ops[i].index;
-	    newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
-	    if ((newp = realloc(oldp, newsize)) == NULL)
+	case GROW:
+	    if ((newp = realloc(blocks[ids[i]], sizes[i])) == NULL)
 		unix_error("realloc failed in eval_libc_speed\n");
-	    
-	    trace->blocks[index] = newp;
+	    blocks[ids[i]] = newp;
 	    break;
 	    
         case FREE: /* free */
-	    index = trace->ops[i].index;
-	    block = trace->blocks[index];
-	    free(block);
+        case GFREE:
+	    free(blocks[ids[i]]);
 	    break;
 	}
     }
 }
 
+/*****************************************************************
+ * The following routines compare this run's timings with those of an
+ * earlier run (-b), read from its -o json results. Both runs must
+ * have timed each trace one run at a time (-n), and the comparison is
+ * between those samples.
+ ****************************************************************/
+
+/*
+ * read_baseline - Read the file name and mm stats of every trace in
+ *     the -o json results at path. Only reads what printjson writes, 
+ *     not JSON in general. Returns the number of traces.
+ */
+static int read_baseline(char *path, baseline_t **base)
+{
+    FILE *fp;
+    char *buf, *p, *q, *end;
+    long len;
+    int n = 0, k;
+    stats_t *s;
+
+    if ((fp = fopen(path, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in read_baseline", path);
+	unix_error(msg);
+    }
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    rewind(fp);
+    if ((buf = (char *)malloc(len + 1)) == NULL)
+	unix_error("malloc failed in read_baseline");
+    if (fread(buf, 1, len, fp) != (size_t)len)
+	unix_error("fread failed in read_baseline");
+    buf[len] = '\0';
+    fclose(fp);
+
+    *base = NULL;
+    for (p = buf; (p = strstr(p, "\"file\": \"")) != NULL; n++) {
+	if ((*base = (baseline_t *)realloc(*base, (n+1) * sizeof(baseline_t)))
+	    == NULL)
+	    unix_error("realloc failed in read_baseline");
+	memset(&(*base)[n], 0, sizeof(baseline_t));
+
+	/* The file name, undoing printjson_string's escapes */
+	p += strlen("\"file\": \"");
+	(*base)[n].file = q = p;
+	for (; *p && *p != '"'; p++) {
+	    if (*p == '\\' && p[1])
+		p++;
+	    *q++ = *p;
+	}
+	if (*p == '\0')
+	    app_error("Truncated file name in the baseline");
+	p++;
+	*q = '\0';
+
+	/* The mm object, which has no objects inside it */
+	if ((p = strstr(p, "\"mm\": {")) == NULL ||
+	    (end = strchr(p, '}')) == NULL)
+	    app_error("A baseline trace has no mm stats");
+	s = &(*base)[n].mm;
+	if ((q = strstr(p, "\"valid\": true")) != NULL && q < end)
+	    s->valid = 1;
+	if ((q = strstr(p, "\"secs\": ")) != NULL && q < end)
+	    s->secs = atof(q + strlen("\"secs\": "));
+	if ((q = strstr(p, "\"samples\": [")) != NULL && q < end) {
+	    q += strlen("\"samples\": [");
+	    for (k = 0; k < MAX_SAMPLES && *q != ']'; k++) {
+		s->samples[k] = strtod(q, &q);
+		while (*q == ',' || *q == ' ' || *q == '\n')
+		    q++;
+	    }
+	    s->nsamples = k;
+	}
+	p = end;
+    }
+    return n;
+}
+
+/*
+ * trace_name - The file name of the trace at path, without directories
+ */
+static char *trace_name(char *path)
+{
+    char *slash = strrchr(path, '/');
+
+    return slash ? slash + 1 : path;
+}
+
+/*
+ * compare_baseline - For every trace, print the median time in the
+ *     baseline and in this run (matching traces by file name, whatever
+ *     their directory), the speedup (baseline/now, so >1 is faster)
+ *     with a bootstrap confidence interval, and the p-value of a
+ *     Mann-Whitney U test. A trace has changed if p < ALPHA and the 
+ *     whole interval is more than MIN_CHANGE away from 1: separately
+ *     started runs of the same code often differ by a few percent. 
+ *     Returns the number of traces that got significantly slower.
+ */
+static int compare_baseline(char *path, char **tracefiles, int n, 
+			    stats_t *mm_stats)
+{
+    baseline_t *base;
+    stats_t *b, *s;
+    int nbase, i, k, slower = 0, faster = 0;
+    double speedup, lo, hi, p;
+    char *verdict;
+
+    nbase = read_baseline(path, &base);
+    printf("\nComparison with baseline %s (%.0f%% CI, alpha %g, "
+	   "min change %.0f%%):\n", path, (1 - ALPHA) * 100, ALPHA, 
+	   MIN_CHANGE * 100);
+    printf("%5s%12s%12s%9s%20s%10s\n", 
+	   "trace", "base usecs", "usecs", "speedup", "CI", "p");
+    for (i = 0; i < n; i++) {
+	s = &mm_stats[i];
+	for (k = 0; k < nbase && strcmp(trace_name(base[k].file), 
+					 trace_name(tracefiles[i])); k++)
+	    ;
+	b = (k < nbase) ? &base[k].mm : NULL;
+	if (b == NULL || !b->valid || !s->valid || 
+	    b->nsamples < 2 || s->nsamples < 2) {
+	    printf("%5d%12s%12s%9s%20s%10s  %s\n", i, "-", "-", "-", "-", "-",
+		   b == NULL ? "not in baseline" : 
+		   (!b->valid || !s->valid) ? "invalid" : "no samples");
+	    continue;
+	}
+	speedup = sample_median(b->samples, b->nsamples) / s->secs;
+	sample_ratio_ci(b->samples, b->nsamples, s->samples, s->nsamples,
+			1 - ALPHA, NBOOT, &lo, &hi);
+	p = sample_mannwhitney(b->samples, b->nsamples, 
+			       s->samples, s->nsamples);
+	verdict = "";
+	if (p < ALPHA && hi < 1 - MIN_CHANGE) {
+	    verdict = "SLOWER";
+	    slower++;
+	}
+	else if (p < ALPHA && lo > 1 + MIN_CHANGE) {
+	    verdict = "faster";
+	    faster++;
+	}
+	printf("%5d%12.1f%12.1f%8.3fx  [%6.3f, %6.3f]%10.4f  %s\n", i, 
+	       sample_median(b->samples, b->nsamples) * 1e6, s->secs * 1e6, 
+	       speedup, 
+	       lo, hi, p, verdict);
+    }
+    printf("%d trace(s) faster, %d slower than the baseline\n", 
+	   faster, slower);
+    free(base);
+    return slower;
+}
+
 /*************************************
  * Some miscellaneous helper routines
  ************************************/
@@ -907,7 +2643,18 @@ static void printresults(int n, stats_t *stats)
     printf("%5s%7s %5s%8s%10s%6s\n", 
 	   "trace", " valid", "util", "ops", "secs", "Kops");
     for (i=0; i < n; i++) {
-	if (stats[i].valid) {
+	if (stats[i].valid && quick) {
+	    printf("%2d%10s%5.0f%%%8.0f%10s%6s\n", 
+		   i,
+		   "yes",
+		   stats[i].util*100.0,
+		   stats[i].ops,
+		   "-",
+		   "-");
+	    ops += stats[i].ops;
+	    util += stats[i].util;
+	}
+	else if (stats[i].valid) {
 	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
 		   i,
 		   "yes",
@@ -931,7 +2678,15 @@ static void printresults(int n, stats_t *stats)
     }
 
     /* Print the aggregate results for the set of traces */
-    if (errors == 0) {
+    if (errors == 0 && quick) {
+	printf("%12s%5.0f%%%8.0f%10s%6s\n", 
+	       "Total       ",
+	       (util/n)*100.0,
+	       ops, 
+	       "-",
+	       "-");
+    }
+    else if (errors == 0) {
 	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
 	       "Total       ",
 	       (util/n)*100.0,
@@ -950,6 +2705,381 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printcold - prints the warm and cold heap running times of the mm
+ *    package side by side. The difference is the time spent taking
+ *    page faults on a freshly mapped heap.
+ */
+static void printcold(int n, stats_t *stats)
+{
+    int i;
+    double secs = 0;
+    double cold_secs = 0;
+    double ops = 0;
+
+    if (verbose) {
+	printf("Cold heap results for mm malloc:\n");
+	printf("%5s%8s%10s%6s%10s%6s%10s\n", 
+	       "trace", "ops", "warm secs", "Kops", "cold secs", "Kops",
+	       "faults");
+    }
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	if (verbose)
+	    printf("%2d%11.0f%10.6f%6.0f%10.6f%6.0f%10.6f\n", 
+		   i,
+		   stats[i].ops,
+		   stats[i].secs,
+		   (stats[i].ops/1e3)/stats[i].secs,
+		   stats[i].cold_secs,
+		   (stats[i].ops/1e3)/stats[i].cold_secs,
+		   stats[i].cold_secs - stats[i].secs);
+	secs += stats[i].secs;
+	cold_secs += stats[i].cold_secs;
+	ops += stats[i].ops;
+    }
+    if (errors == 0 && secs > 0 && cold_secs > 0)
+	printf("Heap timing: %.0f Kops warm, %.0f Kops cold, "
+	       "%.6f secs in page faults\n",
+	       (ops/1e3)/secs, (ops/1e3)/cold_secs, cold_secs - secs);
+    if (verbose)
+	printf("\n");
+}
+
+/*
+ * printcache - prints the running time on cold caches (-x) next to
+ *    the running time on warm ones
+ */
+static void printcache(int n, stats_t *stats)
+{
+    int i;
+    double secs = 0;
+    double evict_secs = 0;
+    double ops = 0;
+
+    if (verbose) {
+	printf("Cold cache results for mm malloc:\n");
+	printf("%5s%8s%12s%12s%10s\n", 
+	       "trace", "ops", "warm usecs", "cold usecs", "slowdown");
+    }
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	if (verbose)
+	    printf("%2d%11.0f%12.1f%12.1f%9.2fx\n", 
+		   i,
+		   stats[i].ops,
+		   stats[i].secs*1e6,
+		   stats[i].evict_secs*1e6,
+		   stats[i].evict_secs / stats[i].secs);
+	secs += stats[i].secs;
+	evict_secs += stats[i].evict_secs;
+	ops += stats[i].ops;
+    }
+    if (errors == 0 && secs > 0 && evict_secs > 0)
+	printf("Cache timing: %.0f Kops warm, %.0f Kops after evicting the "
+	       "%lu KB LLC (%.2fx slower)\n",
+	       (ops/1e3)/secs, (ops/1e3)/evict_secs, 
+	       (unsigned long)(cache_llc_bytes() >> 10), evict_secs/secs);
+    if (verbose)
+	printf("\n");
+}
+
+/*
+ * printharness - prints the time of the replay on the two null
+ *    allocators (-z) next to the package's, and its throughput with
+ *    and without the replay's share
+ */
+static void printharness(int n, stats_t *stats)
+{
+    int i;
+    double secs = 0;
+    double net_secs = 0;
+    double ops = 0;
+
+    if (verbose) {
+	printf("Replay overhead for mm malloc:\n");
+	printf("%5s%8s%12s%12s%12s%10s%10s\n", "trace", "ops", "usecs",
+	       "bump usecs", "fixed usecs", "raw Kops", "net Kops");
+    }
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	if (verbose)
+	    printf("%2d%11.0f%12.1f%12.1f%12.1f%10.0f%10.0f\n", 
+		   i,
+		   stats[i].ops,
+		   stats[i].secs*1e6,
+		   stats[i].bump_secs*1e6,
+		   stats[i].fixed_secs*1e6,
+		   (stats[i].ops/1e3)/stats[i].secs,
+		   (stats[i].ops/1e3)/trace_secs(&stats[i]));
+	secs += stats[i].secs;
+	net_secs += trace_secs(&stats[i]);
+	ops += stats[i].ops;
+    }
+    if (errors == 0 && secs > 0)
+	printf("Replay overhead: %.0f%% of the time; %.0f Kops raw, "
+	       "%.0f Kops net\n", (1 - net_secs/secs)*100, 
+	       (ops/1e3)/secs, (ops/1e3)/net_secs);
+    if (verbose)
+	printf("\n");
+}
+
+/*
+ * printcopy - prints how many bytes the mm package copied to serve
+ *    reallocs, next to the bytes it remapped instead and the bytes
+ *    growable blocks gained in place. Traces without reallocs are 
+ *    left out.
+ */
+static void printcopy(int n, stats_t *stats)
+{
+    int i, header = 0;
+
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || (stats[i].copied == 0 && 
+				stats[i].remapped == 0 && stats[i].grown == 0))
+	    continue;
+	if (!header) {
+	    printf("Realloc copy traffic for mm malloc:\n");
+	    printf("%5s%14s%14s%14s\n", "trace", "copied", "remapped", "grown");
+	    header = 1;
+	}
+	printf("%2d%17.0f%14.0f%14.0f\n", i, stats[i].copied, 
+	       stats[i].remapped, stats[i].grown);
+    }
+    if (header)
+	printf("\n");
+}
+
+/*
+ * printutil - prints each trace's utilization at the end, averaged
+ *    over the trace and in its worst window (-U). With -U, the average
+ *    is what the performance index uses.
+ */
+static void printutil(int n, stats_t *stats)
+{
+    int i, valid = 0;
+    double util = 0, avg_util = 0, worst_util = 1;
+
+    if (verbose) {
+	printf("Utilization over time for mm malloc (every %d requests):\n",
+	       util_every);
+	printf("%5s%10s%10s%12s\n", "trace", "end util", "avg util", 
+	       "worst util");
+    }
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid)
+	    continue;
+	if (verbose)
+	    printf("%2d%12.1f%%%9.1f%%%11.1f%%\n", i, stats[i].util*100.0,
+		   stats[i].avg_util*100.0, stats[i].worst_util*100.0);
+	util += stats[i].util;
+	avg_util += stats[i].avg_util;
+	if (stats[i].worst_util < worst_util)
+	    worst_util = stats[i].worst_util;
+	valid++;
+    }
+    if (valid > 0)
+	printf("Utilization: %.1f%% at the end, %.1f%% over time (used for "
+	       "the index), worst window %.1f%%\n", util/valid*100.0,
+	       avg_util/valid*100.0, worst_util*100.0);
+    if (verbose)
+	printf("\n");
+}
+
+/*
+ * printevents - prints the hardware events per request in each trace
+ *    (-e), and the instructions per cycle. Events the CPU couldn't
+ *    count are shown as "-".
+ */
+static void printevents(int n, stats_t *stats)
+{
+    static char *heads[PC_NEVENTS] = {"instrs", "cycles", "L1D miss",
+				      "LLC miss", "dTLB miss", "br miss"};
+    double *e;
+    int i, j;
+
+    printf("Hardware events per request for mm malloc:\n");
+    printf("%5s", "trace");
+    for (j = 0; j < PC_NEVENTS; j++)
+	printf("%11s", heads[j]);
+    printf("%7s\n", "IPC");
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || !stats[i].counted)
+	    continue;
+	e = stats[i].events;
+	printf("%2d   ", i);
+	for (j = 0; j < PC_NEVENTS; j++) {
+	    if (e[j] < 0)
+		printf("%11s", "-");
+	    else
+		printf("%11.2f", e[j] / stats[i].ops);
+	}
+	if (e[PC_INSTRUCTIONS] >= 0 && e[PC_CYCLES] > 0)
+	    printf("%7.2f\n", e[PC_INSTRUCTIONS] / e[PC_CYCLES]);
+	else
+	    printf("%7s\n", "-");
+    }
+    printf("\n");
+}
+
+/*
+ * printlatency - prints the request latency percentiles of each trace
+ *    that was timed request by request (-L), in trace order, and
+ *    forgets them for the next package
+ */
+static void printlatency(int n)
+{
+    static char *names[] = {"malloc", "free", "realloc"};
+    latency_t *lat;
+    int i, k;
+
+    for (i=0; i < n; i++) {
+	lat = &latencies[i];
+	if (!lat->measured)
+	    continue;
+	printf("Latency of mm malloc on trace %d "
+	       "(TSC ticks, less %llu timer overhead):\n", i, lat->ovhd);
+	printf("%8s%10s%10s%10s%10s%12s\n", 
+	       "request", "count", "p50", "p99", "p99.9", "max");
+	for (k = 0; k < 3; k++) {
+	    if (lat->count[k] == 0)
+		continue;
+	    printf("%8s%10llu%10llu%10llu%10llu%12llu\n", names[k], 
+		   lat->count[k], lat->p50[k], lat->p99[k], lat->p999[k],
+		   lat->max[k]);
+	}
+    }
+    memset(latencies, 0, n * sizeof(latency_t));
+}
+
+/*
+ * printstable - prints the best, median and MAD of each trace's
+ *    timed runs (-R), flags the traces whose MAD is above NOISY_MAD of
+ *    their median, and prints the frequency governor of the CPUs the
+ *    traces ran on. Anything but "performance" lets the clock change
+ *    between runs, and turbo lets it depend on the other cores' load.
+ */
+static void printstable(int n, stats_t *stats, int *cpus, int ncpus, 
+			int jobs)
+{
+    char gov[MAXLINE];
+    double min, med, mad;
+    int i, noisy = 0, valid = 0, turbo;
+
+    if (verbose) {
+	printf("Timing spread for mm malloc (%d runs after %d warm-up):\n",
+	       nsamples, warmup);
+	printf("%5s%12s%12s%10s%8s\n", "trace", "min usecs", "med usecs",
+	       "MAD usecs", "MAD");
+    }
+    for (i=0; i < n; i++) {
+	if (!stats[i].valid || stats[i].nsamples == 0)
+	    continue;
+	min = sample_min(stats[i].samples, stats[i].nsamples);
+	med = sample_median(stats[i].samples, stats[i].nsamples);
+	mad = sample_mad(stats[i].samples, stats[i].nsamples);
+	if (verbose)
+	    printf("%2d%15.1f%12.1f%10.1f%7.1f%%%s\n", i, min*1e6, med*1e6,
+		   mad*1e6, mad/med*100.0, mad > NOISY_MAD*med ? "  noisy" : "");
+	noisy += mad > NOISY_MAD*med;
+	valid++;
+    }
+
+    if (jobs > 1) {
+	for (i = 0; i < ncpus && i < jobs; i++) {
+	    cpu_governor(cpus[i], gov, MAXLINE);
+	    printf("%sCPU %d governor %s", i ? ", " : "Pinned children: ",
+		   cpus[i], gov);
+	}
+    }
+    else {
+	cpu_governor(stable_cpu, gov, MAXLINE);
+	printf("Pinned to CPU %d, governor %s", stable_cpu, gov);
+    }
+    turbo = cpu_turbo();
+    printf(", turbo %s\n", turbo < 0 ? "unknown" : (turbo ? "on" : "off"));
+    if (noisy)
+	printf("Warning: %d of %d traces are noisy (MAD above %.0f%% of the "
+	       "median); compare them with care\n", noisy, valid, 
+	       NOISY_MAD*100);
+    if (verbose)
+	printf("\n");
+}
+
+/*
+ * perf_index - Return the performance index of a package from its
+ *    stats on n traces, 0 if it had errors, and its utilization and
+ *    throughput parts in p1 and p2. With -U the utilization part is
+ *    the time-averaged one, and with -z the throughput is net of the
+ *    replay's own time.
+ */
+static double perf_index(int n, stats_t *stats, int nerrors, double *p1, 
+			 double *p2)
+{
+    double secs = 0, ops = 0, util = 0, avg_util, avg_throughput;
+    int i;
+
+    for (i=0; i < n; i++) {
+	secs += trace_secs(&stats[i]);
+	ops += stats[i].ops;
+	util += util_every ? stats[i].avg_util : stats[i].util;
+    }
+    avg_util = util/n;
+
+    *p1 = *p2 = 0;
+    if (nerrors > 0)
+	return 0.0;
+    avg_throughput = ops/secs;
+    *p1 = UTIL_WEIGHT * avg_util;
+    if (avg_throughput > AVG_LIBC_THRUPUT)
+	*p2 = (double)(1.0 - UTIL_WEIGHT);
+    else
+	*p2 = ((double) (1.0 - UTIL_WEIGHT)) * 
+	    (avg_throughput/AVG_LIBC_THRUPUT);
+    return (*p1 + *p2)*100.0;
+}
+
+/*
+ * printplugins - prints the utilization and throughput of every -m
+ *    package on each trace, side by side, and their performance 
+ *    indexes. Results of a trace the package failed are shown as "-".
+ */
+static void printplugins(int n, char **names, stats_t **stats, 
+			 int *nerrors, int nplugins)
+{
+    double p1, p2;
+    stats_t *s;
+    int i, k;
+
+    printf("Packages side by side (util%%, Kops):\n%5s", "trace");
+    for (k = 0; k < nplugins; k++)
+	printf("%16.15s", trace_name(names[k]));
+    printf("\n");
+    for (i=0; i < n; i++) {
+	printf("%2d   ", i);
+	for (k = 0; k < nplugins; k++) {
+	    s = &stats[k][i];
+	    if (s->valid)
+		printf("%7.0f%%%8.0f", s->util*100.0, 
+		       (s->ops/1e3)/trace_secs(s));
+	    else
+		printf("%16s", "-");
+	}
+	printf("\n");
+    }
+    printf("%-5s", "index");
+    for (k = 0; k < nplugins; k++) {
+	if (nerrors[k] > 0)
+	    printf("%16s", "errors");
+	else
+	    printf("%16.0f", perf_index(n, stats[k], 0, &p1, &p2));
+    }
+    printf("\n\n");
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -977,18 +3107,245 @@ void malloc_error(int tracenum, int opnum, char *msg)
     printf("ERROR [trace %d, line %d]: %s\n", tracenum, LINENUM(opnum), msg);
 }
 
+/*
+ * printjson_string - prints s as a quoted JSON string
+ */
+static void printjson_string(FILE *out, char *s)
+{
+    fputc('"', out);
+    for (; *s; s++) {
+	if (*s == '"' || *s == '\\')
+	    fputc('\\', out);
+	if ((unsigned char)*s < ' ')
+	    fprintf(out, "\\u%04x", *s);
+	else
+	    fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+/*
+ * printjson_stats - prints one stats_t as a JSON object. Fields that
+ *    are undefined for an invalid trace are null.
+ */
+static void printjson_stats(FILE *out, stats_t *s)
+{
+    int i;
+
+    fprintf(out, "{\"valid\": %s, \"ops\": %.0f, ", 
+	    s->valid ? "true" : "false", s->ops);
+    if (s->valid)
+	fprintf(out, "\"util\": %.6f, \"secs\": %.9f, \"kops\": %.3f, ", 
+		s->util, s->secs, (s->ops/1e3)/s->secs);
+    else
+	fprintf(out, "\"util\": null, \"secs\": null, \"kops\": null, ");
+    fprintf(out, "\"cold_secs\": %.9f, \"copied\": %.0f, "
+	    "\"remapped\": %.0f, \"grown\": %.0f", 
+	    s->cold_secs, s->copied, s->remapped, s->grown);
+    if (cold_cache && s->valid)
+	fprintf(out, ", \"evict_secs\": %.9f", s->evict_secs);
+    if (net && s->valid && s->bump_secs > 0)
+	fprintf(out, ",\n        \"bump_secs\": %.9f, \"fixed_secs\": %.9f, "
+		"\"net_secs\": %.9f", s->bump_secs, s->fixed_secs, 
+		trace_secs(s));
+    if (util_every && s->valid)
+	fprintf(out, ", \"avg_util\": %.6f, \"worst_util\": %.6f",
+		s->avg_util, s->worst_util);
+    if (s->counted) {
+	fprintf(out, ",\n        \"events\": {");
+	for (i = 0; i < PC_NEVENTS; i++) {
+	    fprintf(out, "%s\"%s\": ", i ? ", " : "", perfctr_name(i));
+	    if (s->events[i] < 0)
+		fprintf(out, "null");
+	    else
+		fprintf(out, "%.0f", s->events[i]);
+	}
+	fprintf(out, "}");
+    }
+    if (s->nsamples > 0) {
+	fprintf(out, ",\n        \"min_secs\": %.9f, \"mad_secs\": %.9f",
+		sample_min(s->samples, s->nsamples), 
+		sample_mad(s->samples, s->nsamples));
+	fprintf(out, ",\n        \"samples\": [");
+	for (i = 0; i < s->nsamples; i++)
+	    fprintf(out, "%s%.9f", i ? ", " : "", s->samples[i]);
+	fprintf(out, "]");
+    }
+    fprintf(out, "}");
+}
+
+/*
+ * printjson - prints the build configuration and every per-trace 
+ *    stats_t of the mm package (and of libc with -l) as one JSON 
+ *    document. mm_config's name=value pairs become the "mm" object.
+ */
+static void printjson(FILE *out, char **tracefiles, int n, 
+		      stats_t *libc_stats, stats_t *mm_stats, 
+		      double perfindex)
+{
+    char config[MAXLINE], *pair, *eq;
+    int i, first = 1;
+
+    fprintf(out, "{\n  \"config\": {\"ALIGNMENT\": %d, \"MAX_HEAP\": %lu, "
+	    "\"UTIL_WEIGHT\": %g, \"AVG_LIBC_THRUPUT\": %g, "
+	    "\"timer\": \"%s\",\n             \"mm\": {", 
+	    ALIGNMENT, (unsigned long)max_heap, UTIL_WEIGHT, 
+	    AVG_LIBC_THRUPUT, fsecs_timer());
+    strncpy(config, mm->config ? mm->config() : "", MAXLINE-1);
+    config[MAXLINE-1] = '\0';
+    for (pair = strtok(config, " "); pair; pair = strtok(NULL, " ")) {
+	if ((eq = strchr(pair, '=')) == NULL)
+	    continue;
+	*eq = '\0';
+	fprintf(out, "%s\"%s\": \"%s\"", first ? "" : ", ", pair, eq+1);
+	first = 0;
+    }
+    fprintf(out, "}},\n");
+    fprintf(out, "  \"options\": {\"threads\": %d, \"shard\": %s, "
+	    "\"stream\": %s, \"prefault\": %s", nthreads, 
+	    shard ? "true" : "false", stream ? "true" : "false", 
+	    prefault ? "true" : "false");
+    if (nsamples > 0)
+	fprintf(out, ", \"samples\": %d, \"warmup\": %d", nsamples, warmup);
+    if (stable_cpu >= 0) {
+	cpu_governor(stable_cpu, config, MAXLINE);
+	fprintf(out, ", \"cpu\": %d, \"governor\": ", stable_cpu);
+	printjson_string(out, config);
+    }
+    fprintf(out, "},\n");
+
+    fprintf(out, "  \"traces\": [\n");
+    for (i = 0; i < n; i++) {
+	fprintf(out, "    {\"trace\": %d, \"file\": ", i);
+	printjson_string(out, tracefiles[i]);
+	fprintf(out, ",\n     \"mm\": ");
+	printjson_stats(out, &mm_stats[i]);
+	if (libc_stats) {
+	    fprintf(out, ",\n     \"libc\": ");
+	    printjson_stats(out, &libc_stats[i]);
+	}
+	fprintf(out, "}%s\n", (i < n-1) ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+    fprintf(out, "  \"errors\": %d,\n  \"perfidx\": %.2f\n}\n", 
+	    errors, perfindex);
+}
+
+/*
+ * printcsv_stats - prints one stats_t as a CSV row, with the same
+ *    fields as printjson_stats except the samples themselves. Fields 
+ *    of a mode that is off, or undefined for the trace, are empty.
+ */
+static void printcsv_stats(FILE *out, char *package, int i, char *file,
+			   stats_t *s)
+{
+    int k;
+
+    fprintf(out, "%s,%d,%s,%d,%.0f,", package, i, file, s->valid, s->ops);
+    if (s->valid)
+	fprintf(out, "%.6f,%.9f,%.3f,", 
+		s->util, s->secs, (s->ops/1e3)/s->secs);
+    else
+	fprintf(out, ",,,");
+    fprintf(out, "%.9f,%.0f,%.0f,%.0f,", 
+	    s->cold_secs, s->copied, s->remapped, s->grown);
+    if (util_every && s->valid)
+	fprintf(out, "%.6f,%.6f,", s->avg_util, s->worst_util);
+    else
+	fprintf(out, ",,");
+    if (cold_cache && s->valid)
+	fprintf(out, "%.9f,", s->evict_secs);
+    else
+	fprintf(out, ",");
+    if (net && s->valid && s->bump_secs > 0)
+	fprintf(out, "%.9f,%.9f,%.9f,", s->bump_secs, s->fixed_secs,
+		trace_secs(s));
+    else
+	fprintf(out, ",,,");
+    if (s->nsamples > 0)
+	fprintf(out, "%d,%.9f,%.9f", s->nsamples, 
+		sample_min(s->samples, s->nsamples), 
+		sample_mad(s->samples, s->nsamples));
+    else
+	fprintf(out, ",,");
+    for (k = 0; k < PC_NEVENTS; k++) {
+	if (s->counted && s->events[k] >= 0)
+	    fprintf(out, ",%.0f", s->events[k]);
+	else
+	    fprintf(out, ",");
+    }
+    fprintf(out, "\n");
+}
+
+/*
+ * printcsv - prints one CSV row per trace and package. The build 
+ *    configuration and the Perf index go on "#" comment lines.
+ */
+static void printcsv(FILE *out, char **tracefiles, int n, 
+		     stats_t *libc_stats, stats_t *mm_stats, 
+		     double perfindex)
+{
+    int i, k;
+
+    fprintf(out, "# ALIGNMENT=%d MAX_HEAP=%lu UTIL_WEIGHT=%g "
+	    "AVG_LIBC_THRUPUT=%g timer=%s %s\n", ALIGNMENT, 
+	    (unsigned long)max_heap, UTIL_WEIGHT, AVG_LIBC_THRUPUT, 
+	    fsecs_timer(), mm->config ? mm->config() : "");
+    fprintf(out, "# threads=%d shard=%d stream=%d prefault=%d\n", 
+	    nthreads, shard, stream, prefault);
+    fprintf(out, "package,trace,file,valid,ops,util,secs,kops,"
+	    "cold_secs,copied,remapped,grown,avg_util,worst_util,"
+	    "evict_secs,bump_secs,fixed_secs,net_secs,samples,min_secs,"
+	    "mad_secs");
+    for (k = 0; k < PC_NEVENTS; k++)
+	fprintf(out, ",%s", perfctr_name(k));
+    fprintf(out, "\n");
+    for (i = 0; i < n; i++) {
+	if (libc_stats)
+	    printcsv_stats(out, "libc", i, tracefiles[i], &libc_stats[i]);
+	printcsv_stats(out, "mm", i, tracefiles[i], &mm_stats[i]);
+    }
+    fprintf(out, "# errors=%d perfidx=%.2f\n", errors, perfindex);
+}
+
 /* 
  * usage - Explain the command line arguments
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValPCSsLeRxzq] [-o json|csv] [-j <n>] [-p <cpus>] [-T <n>] [-n <n>] [-w <n>] [-b <json>] [-m <so>] [-H <MB>] [-U <n>] [-k <n>] [-f <file>] [-t <dir>]\n");
     fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b <json>  Compare the timings to an earlier -o json run\n");
+    fprintf(stderr, "\t           (--baseline); exit 1 if a trace got slower.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-m <so>    Evaluate the package in <so> instead of mm.c; repeat\n");
+    fprintf(stderr, "\t           to compare several side by side.\n");
+    fprintf(stderr, "\t-o <fmt>   Write the results to stdout as json or csv.\n");
+    fprintf(stderr, "\t-H <MB>    Give the simulated heap <MB> megabytes (default %d).\n",
+	    (int)(MAX_HEAP >> 20));
+    fprintf(stderr, "\t-C         Also time mm malloc on a cold heap.\n");
+    fprintf(stderr, "\t-x         Also time mm malloc on cold caches (--cold-cache).\n");
+    fprintf(stderr, "\t-q         Only check the traces and their utilization, untimed (--quick).\n");
+    fprintf(stderr, "\t-k <n>     Fill and check the payloads of every <n>th block only.\n");
+    fprintf(stderr, "\t-z         Subtract the replay's own time, timed on null allocators (--net).\n");
+    fprintf(stderr, "\t-L         Print per-request latency percentiles.\n");
+    fprintf(stderr, "\t-e         Count hardware events per request (perf_event_open).\n");
+    fprintf(stderr, "\t-P         Pre-fault the heap before timing.\n");
+    fprintf(stderr, "\t-S         Stream each trace through mm malloc once.\n");
+    fprintf(stderr, "\t-j <n>     Evaluate <n> traces at once in children.\n");
+    fprintf(stderr, "\t-n <n>     Time <n> runs of each trace one by one (--samples).\n");
+    fprintf(stderr, "\t-p <cpus>  Pin the -j children to <cpus>, e.g. 2-5,8.\n");
+    fprintf(stderr, "\t-R         Pin the driver, warm up, and report min/median/MAD\n");
+    fprintf(stderr, "\t           of %d runs of each trace (--stable).\n", DEF_SAMPLES);
+    fprintf(stderr, "\t-T <n>     Replay each trace on <n> threads at once.\n");
+    fprintf(stderr, "\t-s         With -T, split each trace between the threads by id.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
+    fprintf(stderr, "\t-w <n>     Run each trace <n> times before the -n runs (--warmup).\n");
+    fprintf(stderr, "\t-U <n>     Sample utilization every <n> requests and score its\n");
+    fprintf(stderr, "\t           average; --curve <file> writes the samples as CSV.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
@@ -3,35 +3,288 @@
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
  */
+#define _GNU_SOURCE  /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* 
+ * A file-backed (see mem_open) or shared (see mem_open_shm) heap starts
+ * with one page holding this header, followed by the heap itself. The
+ * header lets every process that maps the heap find its brk. A private
+ * heap keeps the same header in a static variable.
+ */
+#define MEM_MAGIC 0x6d656d68 /* "memh" */
+
+typedef struct {
+    unsigned int magic;    /* MEM_MAGIC once the image is initialized */
+    size_t max_heap;       /* bytes of heap following the header page */
+    size_t brk;            /* heap size in bytes */
+    pthread_mutex_t lock;  /* serializes mm calls on a shared heap */
+} mem_hdr_t;
+
+/*
+ * Besides the heap, the malloc package can reserve address ranges of
+ * its own (see mem_reserve), e.g. for blocks that must be able to grow
+ * without moving. Every reservation is recorded in a doubly linked
+ * list, and hashed by its base into one of MEM_MAP_BUCKETS chains, so
+ * that mem_commit, mem_release and mem_remap find it without walking
+ * the list. Only mem_in_map, which is given an address anywhere in a
+ * reservation, still walks it.
+ */
+#define MEM_MAP_BITS    10
+#define MEM_MAP_BUCKETS (1 << MEM_MAP_BITS)
+#define MEM_MAP_HASH(base) \
+    ((unsigned)(((unsigned long)(base) >> 12) * 2654435769U) >> \
+     (32 - MEM_MAP_BITS))
+
+typedef struct mem_map_t {
+    char *base;              /* first byte of the reservation */
+    size_t reserved;         /* bytes of address space reserved */
+    size_t committed;        /* bytes at base that are readable/writable */
+    struct mem_map_t *next;  /* next list element */
+    struct mem_map_t *prev;  /* previous list element */
+    struct mem_map_t *chain; /* next reservation in the same bucket */
+} mem_map_t;
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static size_t mem_max_heap = MAX_HEAP; /* size of the next heap we map */
+
+static mem_hdr_t mem_priv_hdr; /* header of a private heap */
+static mem_hdr_t *mem_hdr = &mem_priv_hdr; /* header of the current heap */
+static char *mem_map_start;  /* start of the mapping holding the heap */
+static size_t mem_map_len;   /* length of that mapping */
+static int mem_fd = -1;      /* backing file or shm object, if any */
+static int mem_file = 0;     /* set if the heap is backed by a file */
+static int mem_shared = 0;   /* set if the heap is shared between processes */
+static mem_map_t *mem_maps;  /* reservations outside the heap */
+static mem_map_t *mem_map_hash[MEM_MAP_BUCKETS]; /* the same, by base */
+static mem_map_t *mem_spare_maps; /* unused records for that list */
+static size_t mem_mapped;    /* bytes committed in those reservations */
+static size_t mem_remapped_bytes; /* bytes carried over by mem_remap */
+static int mem_threaded = 0; /* set if threads share the heap */
+static pthread_mutex_t mem_thread_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The brk pointer lives in the header so that it can be shared */
+#define mem_brk (mem_start_brk + mem_hdr->brk)
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    /* 
+     * allocate the storage we will use to model the available VM. We
+     * map it directly so that its pages can be pre-faulted or handed
+     * back to the kernel (see mem_prefault and mem_discard).
+     */
+    mem_map_len = mem_max_heap;
+    mem_map_start = (char *)mmap(NULL, mem_map_len, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem_map_start == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_hdr = &mem_priv_hdr;
+    mem_hdr->max_heap = mem_max_heap;
+    mem_file = mem_shared = 0;
+    mem_start_brk = mem_map_start;
+    mem_max_addr = mem_start_brk + mem_max_heap; /* max legal heap address */
+    mem_hdr->brk = 0;                            /* heap is empty initially */
+}
+
+/* 
+ * mem_map_fd - map the header page and heap of mem_fd and point the
+ *    private variables at them
+ */
+static int mem_map_fd(void)
+{
+    mem_map_len = mem_pagesize() + mem_max_heap;
+    mem_map_start = (char *)mmap(NULL, mem_map_len, PROT_READ | PROT_WRITE,
+				 MAP_SHARED, mem_fd, 0);
+    if (mem_map_start == MAP_FAILED)
+	return -1;
+
+    mem_hdr = (mem_hdr_t *)mem_map_start;
+    mem_start_brk = mem_map_start + mem_pagesize();
+    mem_max_addr = mem_start_brk + mem_max_heap;
+    return 0;
+}
+
+/* 
+ * mem_open - initialize the memory system model with a heap that lives
+ *    in the file at path. If the file already holds a heap image, it is
+ *    mapped with its old brk; otherwise a new, empty image of the size
+ *    set by mem_set_maxheap is created. Returns 1 if an existing image 
+ *    was attached, 0 if a new one was created, and -1 on error.
+ */
+int mem_open(const char *path)
+{
+    size_t pagesize = mem_pagesize();
+    struct stat st;
+    mem_hdr_t hdr;
+    int attached = 0;
+
+    if ((mem_fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+	fprintf(stderr, "mem_open: cannot open %s: %s\n", path, strerror(errno));
+	return -1;
+    }
+    if (fstat(mem_fd, &st) < 0)
+	goto fail;
+
+    /* Use the size recorded in an existing image, else grow the file */
+    if (st.st_size >= (off_t)(pagesize + sizeof(mem_hdr_t)) &&
+	pread(mem_fd, &hdr, sizeof(hdr), 0) == sizeof(hdr) &&
+	hdr.magic == MEM_MAGIC && 
+	st.st_size >= (off_t)(pagesize + hdr.max_heap)) {
+	mem_max_heap = hdr.max_heap;
+	attached = 1;
+    }
+    else if (ftruncate(mem_fd, 0) < 0 || 
+	     ftruncate(mem_fd, pagesize + mem_max_heap) < 0)
+	goto fail;
+
+    if (mem_map_fd() < 0)
+	goto fail;
+    mem_file = 1;
+    mem_shared = 0;
+    if (!attached) {
+	mem_hdr->max_heap = mem_max_heap;
+	mem_hdr->brk = 0;
+	mem_hdr->magic = MEM_MAGIC;
+    }
+    return attached;
+
+ fail:
+    fprintf(stderr, "mem_open: cannot map %s: %s\n", path, strerror(errno));
+    close(mem_fd);
+    mem_fd = -1;
+    return -1;
+}
+
+/* 
+ * mem_open_shm - initialize the memory system model with a heap in the
+ *    POSIX shared memory object name, which any number of processes may
+ *    map at the same time (each at its own address). The first process
+ *    creates the object with a heap of the size set by mem_set_maxheap;
+ *    it gets 0 back and holds the heap lock, so it can set up the heap
+ *    before calling mem_unlock. Later processes get 1 back once the
+ *    header is ready. Returns -1 on error.
+ */
+int mem_open_shm(const char *name)
+{
+    pthread_mutexattr_t attr;
+    struct stat st;
+    volatile mem_hdr_t *hdr;
+
+    if ((mem_fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) >= 0) {
+	/* We created the object: size it and set up the header */
+	if (ftruncate(mem_fd, mem_pagesize() + mem_max_heap) < 0 ||
+	    mem_map_fd() < 0)
+	    goto fail;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutex_init(&mem_hdr->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	pthread_mutex_lock(&mem_hdr->lock);
+	mem_hdr->max_heap = mem_max_heap;
+	mem_hdr->brk = 0;
+	__sync_synchronize();
+	mem_hdr->magic = MEM_MAGIC;
+	mem_file = 0;
+	mem_shared = 1;
+	return 0;
+    }
+    if (errno != EEXIST || (mem_fd = shm_open(name, O_RDWR, 0600)) < 0) {
+	fprintf(stderr, "mem_open_shm: cannot open %s: %s\n",
+		name, strerror(errno));
+	return -1;
+    }
+
+    /* Someone else created it: wait until its header is ready */
+    do {
+	if (fstat(mem_fd, &st) < 0)
+	    goto fail;
+    } while (st.st_size < (off_t)mem_pagesize() && usleep(1000) == 0);
+    hdr = (volatile mem_hdr_t *)mmap(NULL, mem_pagesize(), PROT_READ,
+				     MAP_SHARED, mem_fd, 0);
+    if (hdr == MAP_FAILED)
+	goto fail;
+    while (hdr->magic != MEM_MAGIC)
+	usleep(1000);
+    mem_max_heap = hdr->max_heap;
+    munmap((void *)hdr, mem_pagesize());
+
+    if (mem_map_fd() < 0)
+	goto fail;
+    mem_file = 0;
+    mem_shared = 1;
+    return 1;
+
+ fail:
+    fprintf(stderr, "mem_open_shm: cannot map %s: %s\n", name, strerror(errno));
+    close(mem_fd);
+    mem_fd = -1;
+    return -1;
+}
+
+/* 
+ * mem_lock, mem_unlock - serialize calls into the malloc package on a
+ *    shared heap, or on any heap once mem_set_threaded has been called.
+ *    Otherwise they do nothing.
+ */
+void mem_lock(void)
+{
+    if (mem_shared)
+	pthread_mutex_lock(&mem_hdr->lock);
+    else if (mem_threaded)
+	pthread_mutex_lock(&mem_thread_lock);
+}
+
+void mem_unlock(void)
+{
+    if (mem_shared)
+	pthread_mutex_unlock(&mem_hdr->lock);
+    else if (mem_threaded)
+	pthread_mutex_unlock(&mem_thread_lock);
+}
+
+/*
+ * mem_set_threaded - tell memlib whether several threads of this 
+ *    process call the malloc package at once, so mem_lock has to lock
+ */
+void mem_set_threaded(int on)
+{
+    mem_threaded = on;
+}
+
+/* 
+ * mem_sync - flush a file-backed heap to its file. Returns 0 on success
+ *    (or if the heap is not file-backed) and -1 on error.
+ */
+int mem_sync(void)
+{
+    if (!mem_file)
+	return 0;
+
+    if (msync(mem_map_start, mem_pagesize() + mem_heapsize(), MS_SYNC) < 0) {
+	fprintf(stderr, "mem_sync: msync error: %s\n", strerror(errno));
+	return -1;
+    }
+    return 0;
 }
 
 /* 
@@ -39,15 +292,260 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    mem_sync();
+    munmap(mem_map_start, mem_map_len);
+    if (mem_fd >= 0) {
+	close(mem_fd);
+	mem_fd = -1;
+    }
+    mem_hdr = &mem_priv_hdr;
+    mem_file = mem_shared = 0;
 }
 
-/*
+/* 
+ * mem_set_maxheap - set the size in bytes of the heap mapped by the next
+ *    call to mem_init, mem_open or mem_open_shm (default MAX_HEAP)
+ */
+void mem_set_maxheap(size_t bytes)
+{
+    mem_max_heap = bytes;
+}
+
+/* 
+ * mem_prefault - touch every page of the simulated heap so that later
+ *    runs don't pay for first-touch page faults
+ */
+void mem_prefault(void)
+{
+    size_t pagesize = mem_pagesize();
+    volatile char *p;
+
+    for (p = mem_start_brk; p < mem_max_addr; p += pagesize)
+	*p = *p;
+}
+
+/* 
+ * mem_discard - hand the pages of the simulated heap back to the
+ *    kernel, so the next run starts on a cold heap and faults every
+ *    page it touches
+ */
+void mem_discard(void)
+{
+    if (madvise(mem_start_brk, mem_max_addr - mem_start_brk, MADV_DONTNEED) < 0)
+	fprintf(stderr, "mem_discard: madvise error: %s\n", strerror(errno));
+}
+
+/* 
  * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ *    and drop every reservation made with mem_reserve
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    mem_hdr->brk = 0;
+    while (mem_maps != NULL)
+	mem_release(mem_maps->base);
+}
+
+/*
+ * mem_new_map, mem_free_map - get and put back a reservation record.
+ *    Records are carved from pages of their own rather than malloc'd,
+ *    because malloc may be the package itself (see libmm.c).
+ */
+static mem_map_t *mem_new_map(void)
+{
+    mem_map_t *m, *page;
+    size_t i, n = mem_pagesize() / sizeof(mem_map_t);
+
+    if (mem_spare_maps == NULL) {
+	page = (mem_map_t *)mmap(NULL, mem_pagesize(), PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (page == MAP_FAILED)
+	    return NULL;
+	for (i = 0; i < n; i++) {
+	    page[i].next = mem_spare_maps;
+	    mem_spare_maps = &page[i];
+	}
+    }
+    m = mem_spare_maps;
+    mem_spare_maps = m->next;
+    return m;
+}
+
+static void mem_free_map(mem_map_t *m)
+{
+    m->next = mem_spare_maps;
+    mem_spare_maps = m;
+}
+
+/*
+ * mem_hash_map, mem_unhash_map - add the record to and remove it from
+ *    the chain for its base
+ */
+static void mem_hash_map(mem_map_t *m)
+{
+    mem_map_t **bucket = &mem_map_hash[MEM_MAP_HASH(m->base)];
+
+    m->chain = *bucket;
+    *bucket = m;
+}
+
+static void mem_unhash_map(mem_map_t *m)
+{
+    mem_map_t **prevp = &mem_map_hash[MEM_MAP_HASH(m->base)];
+
+    while (*prevp != m)
+	prevp = &(*prevp)->chain;
+    *prevp = m->chain;
+}
+
+/*
+ * mem_reserve - reserve bytes of address space outside the heap, without
+ *    committing any memory to it. Returns the base of the reservation, 
+ *    or NULL on error. Reservations are private to the process, even if
+ *    the heap is shared.
+ */
+void *mem_reserve(size_t bytes)
+{
+    mem_map_t *m;
+    size_t pagesize = mem_pagesize();
+
+    if ((m = mem_new_map()) == NULL)
+	return NULL;
+    m->reserved = (bytes + pagesize - 1) & ~(pagesize - 1);
+    m->committed = 0;
+    m->base = (char *)mmap(NULL, m->reserved, PROT_NONE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (m->base == MAP_FAILED) {
+	mem_free_map(m);
+	return NULL;
+    }
+    m->prev = NULL;
+    m->next = mem_maps;
+    if (mem_maps != NULL)
+	mem_maps->prev = m;
+    mem_maps = m;
+    mem_hash_map(m);
+    return m->base;
+}
+
+/*
+ * mem_find_map - return the record of the reservation at base
+ */
+static mem_map_t *mem_find_map(char *base)
+{
+    mem_map_t *m;
+
+    for (m = mem_map_hash[MEM_MAP_HASH(base)]; m != NULL; m = m->chain)
+	if (m->base == base)
+	    return m;
+    fprintf(stderr, "ERROR: %p is not a reservation\n", base);
+    return NULL;
+}
+
+/*
+ * mem_commit - make the first bytes of the reservation at base readable
+ *    and writable. Committed memory is never decommitted, so asking for
+ *    fewer bytes than already committed does nothing. Returns 0 on 
+ *    success and -1 if the reservation is too small.
+ */
+int mem_commit(void *base, size_t bytes)
+{
+    mem_map_t *m;
+    size_t pagesize = mem_pagesize();
+
+    if ((m = mem_find_map(base)) == NULL)
+	return -1;
+    bytes = (bytes + pagesize - 1) & ~(pagesize - 1);
+    if (bytes <= m->committed)
+	return 0;
+    if (bytes > m->reserved) {
+	errno = ENOMEM;
+	return -1;
+    }
+    if (mprotect(m->base + m->committed, bytes - m->committed,
+		 PROT_READ | PROT_WRITE) < 0)
+	return -1;
+    mem_mapped += bytes - m->committed;
+    m->committed = bytes;
+    return 0;
+}
+
+/*
+ * mem_release - unmap the reservation at base
+ */
+void mem_release(void *base)
+{
+    mem_map_t *m;
+
+    if ((m = mem_find_map(base)) == NULL)
+	return;
+    mem_unhash_map(m);
+    if (m->prev != NULL)
+	m->prev->next = m->next;
+    else
+	mem_maps = m->next;
+    if (m->next != NULL)
+	m->next->prev = m->prev;
+    munmap(m->base, m->reserved);
+    mem_mapped -= m->committed;
+    mem_free_map(m);
+}
+
+/*
+ * mem_remap - resize the fully committed reservation at base to bytes,
+ *    moving it if need be. The pages are remapped, not copied. Returns
+ *    the new base, or NULL on error.
+ */
+void *mem_remap(void *base, size_t bytes)
+{
+    mem_map_t *m;
+    char *newbase;
+    size_t pagesize = mem_pagesize();
+
+    if ((m = mem_find_map(base)) == NULL)
+	return NULL;
+    bytes = (bytes + pagesize - 1) & ~(pagesize - 1);
+    newbase = (char *)mremap(m->base, m->reserved, bytes, MREMAP_MAYMOVE);
+    if (newbase == MAP_FAILED)
+	return NULL;
+    mem_remapped_bytes += (bytes < m->committed) ? bytes : m->committed;
+    mem_mapped = mem_mapped - m->committed + bytes;
+    mem_unhash_map(m);
+    m->base = newbase;
+    mem_hash_map(m);
+    m->reserved = m->committed = bytes;
+    return newbase;
+}
+
+/*
+ * mem_remapped - returns the running total of bytes that mem_remap
+ *    carried over to a resized reservation instead of copying them
+ */
+size_t mem_remapped(void)
+{
+    return mem_remapped_bytes;
+}
+
+/*
+ * mem_mapsize - returns the bytes committed outside the heap
+ */
+size_t mem_mapsize(void)
+{
+    return mem_mapped;
+}
+
+/*
+ * mem_in_map - returns true if [lo, hi] lies in the committed part of
+ *    a single reservation
+ */
+int mem_in_map(void *lo, void *hi)
+{
+    mem_map_t *m;
+
+    for (m = mem_maps; m != NULL; m = m->next)
+	if ((char *)lo >= m->base && (char *)hi < m->base + m->committed)
+	    return 1;
+    return 0;
 }
 
 /* 
@@ -59,16 +557,16 @@ void *mem_sbrk(int incr)
 {
     char *old_brk = mem_brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
+    if ( (incr < 0) || ((old_brk + incr) > mem_max_addr)) {
 	errno = ENOMEM;
 	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
 	return (void *)-1;
     }
-    mem_brk += incr;
+    mem_hdr->brk += incr;
     return (void *)old_brk;
 }
 
-/*
+/* 
  * mem_heap_lo - return address of the first heap byte
  */
 void *mem_heap_lo()
@@ -84,15 +582,15 @@ void *mem_heap_hi()
     return (void *)(mem_brk - 1);
 }
 
-/*
+/* 
  * mem_heapsize() - returns the heap size in bytes
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_hdr->brk;
 }
 
-/*
+/* 
  * mem_pagesize() - returns the page size of the system
  */
 size_t mem_pagesize()
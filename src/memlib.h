@@ -1,9 +1,25 @@
 #include <unistd.h>
 
 void mem_init(void);
+int mem_open(const char *path);
+int mem_open_shm(const char *name);
+void mem_lock(void);
+void mem_unlock(void);
+void mem_set_threaded(int on);
+int mem_sync(void);
 void mem_deinit(void);
+void mem_prefault(void);
+void mem_discard(void);
+void mem_set_maxheap(size_t bytes);
 void *mem_sbrk(int incr);
 void mem_reset_brk(void);
+void *mem_reserve(size_t bytes);
+int mem_commit(void *base, size_t bytes);
+void mem_release(void *base);
+void *mem_remap(void *base, size_t bytes);
+size_t mem_remapped(void);
+size_t mem_mapsize(void);
+int mem_in_map(void *lo, void *hi);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
@@ -31,12 +31,13 @@
 #define PACK(size, alloc)  ((size) | (alloc))
 
 /* Read and write a word at address p */
-#define GET(p)     (*(size_t *)(p))
-#define PUT(p, val)  (*(size_t *)(p) = (val))
+#define GET(p)     (*(unsigned int *)(p))
+#define PUT(p, val)  (*(unsigned int *)(p) = (val))
 
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p)  (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
+#define GET_MAPPED(p) (GET(p) & 0x2)
 
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)     ((char *)(bp) - WSIZE)
@@ -46,16 +47,53 @@
 #define NEXT_BLKP(bp)  ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
 #define PREV_BLKP(bp)  ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
 
+/*
+ * Free-list links are stored as heap offsets rather than pointers, so
+ * a heap image stays valid wherever it is mapped (see mm_open). The 
+ * first word of the heap holds the offset of the newest free block.
+ * No block starts at offset 0, so 0 doubles as the null link.
+ */
+#define NIL  0
+#define OFFSET(bp)  ((unsigned int)((char *)(bp) - heap_base))
+#define ADDR(off)   (heap_base + (off))
+
+/* Read and write the head of the free list */
+#define GET_HEAD()     GET(heap_base)
+#define SET_HEAD(off)  PUT(heap_base, (off))
+
+/* Given free block ptr bp, compute address of its prev and next links */
+#define PREVP(bp)  ((char *)(bp))
+#define NEXTP(bp)  ((char *)(bp) + WSIZE)
+
 /* single word (4) or double word (8) alignment */
 /* rounds up to the nearest multiple of ALIGNMENT */
 #define ALIGN(size) (((size) + (DSIZE-1)) & ~0x7)
+/* rounds pointer p up to a multiple of the power of two a */
+#define ALIGN_UP(p, a) \
+  ((char *)(((unsigned long)(p) + (a) - 1) & ~((unsigned long)(a) - 1)))
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
-static char* freeptr = NULL;
+/*
+ * Blocks of MAP_THRESHOLD bytes or more in a private heap get a
+ * page-aligned mapping of their own, so that mm_realloc can resize
+ * them with mem_remap instead of copying. The mapping starts with its
+ * length; the two words right before the payload are a tag derived from
+ * the mapping's address and a header with the mapped bit set. The tag
+ * lets mm_mapped tell such a block from a foreign pointer without
+ * looking it up (see libmm.c).
+ */
+#define MAP_THRESHOLD (256*1024)
+#define MAP_HDR  ALIGN(sizeof(size_t) + DSIZE)
+#define MAP_TAG(base)  ((unsigned int)((unsigned long)(base) >> 12) ^ 0x6d6d6170)
+
+static char* heap_base;  /* first byte of the heap, see mem_heap_lo */
 static char* allocptr;
+static int map_large;    /* set if large blocks get mappings of their own */
 
 // CONVENTION: ptr to a free block points to header+4bytes just as unfreed block
+// The prev link points to the next older free block, the next link to 
+// the next newer one; the head of the list is the newest.
 
 /*
  * delete_node: delete a node from the free list
@@ -64,56 +102,34 @@ static char* allocptr;
 
 static void delete_node(char *brk)
 {
-  if(*(size_t *)(brk) == (void *)-1)
+  unsigned int prev = GET(PREVP(brk));
+  unsigned int next = GET(NEXTP(brk));
+
+  if(next == NIL)
   {
-    if(*(size_t *)(brk+WSIZE) == (void *)-1)
-    {
-      freeptr = NULL;
-      return ;
-    }
-    else
-    {
-      char * next_addr = *((size_t *)(brk+WSIZE));
-      PUT(next_addr, (void *)-1);      
-    }
+  // brk is the head of the list
+    SET_HEAD(prev);
   }
   else
   {
-  // neither the end of list nor the start of list
-      if(*(size_t *)(brk+WSIZE) == (void*)-1)
-      {
-      // if the end of list, namely freeptr         
-        freeptr = *(size_t *)(brk);
-	PUT(freeptr+WSIZE, (void*)-1);	
-	return ;
-      }
-      char * next_addr = *((size_t *)(brk+WSIZE));
-      char * prev_addr = *(size_t *)brk;
-      
-      PUT((prev_addr+WSIZE), next_addr);
-      PUT(next_addr, prev_addr);
+    PUT(PREVP(ADDR(next)), prev);
+  }
+  if(prev != NIL)
+  {
+    PUT(NEXTP(ADDR(prev)), next);
   }
 }
 
 static void add_node(char *brk)
 {
   assert(brk != NULL);
-  if(NULL == freeptr)
-  {
-    freeptr = brk;
-    /* at the first time the prev is itself*/
-    PUT(brk, (void *)-1);
-    PUT(brk+WSIZE, (void *)-1);
-    return ;
-  }
-
-  char * free_addr = freeptr; // which is also the old node
-  char * new_node = brk;
+  unsigned int head = GET_HEAD();
 
-  PUT(brk, free_addr);
-  PUT(brk+WSIZE, (void*)-1);
-  PUT(freeptr+WSIZE, new_node);
-  freeptr = brk;
+  PUT(PREVP(brk), head);
+  PUT(NEXTP(brk), NIL);
+  if(head != NIL)
+    PUT(NEXTP(ADDR(head)), OFFSET(brk));
+  SET_HEAD(OFFSET(brk));
 }
 
 /*
@@ -177,7 +193,7 @@ static char *extend_heap(size_t words)
   char *oldbrk;
   size_t newsize = (words % 2) ? (words+1) * WSIZE : words * WSIZE;
   newsize += DSIZE;
-  if((int)(oldbrk = mem_sbrk(newsize)) == (void*)-1 )
+  if((oldbrk = mem_sbrk(newsize)) == (void*)-1 )
   {
     return NULL;
   }
@@ -192,29 +208,37 @@ static char *extend_heap(size_t words)
 
 static char *find_fit(size_t newsize)
 {
-	char *brk;	
-  /* Search the freelist backwards from freeptr*/
-        if(freeptr == NULL)
-          return NULL;
-
-	for(brk = freeptr; *(size_t *)(brk) != (void*)-1; )
+	unsigned int off;
+  /* Search the freelist backwards from its head */
+	for(off = GET_HEAD(); off != NIL; off = GET(PREVP(ADDR(off))))
 	{
-	  char * prev_ptr = *(size_t *)(brk);
-	  if(newsize < GET_SIZE(HDRP(brk)))
+	  if(newsize <= GET_SIZE(HDRP(ADDR(off))))
 	  {
-	     return brk;
+	     return ADDR(off);
 	  }	  
-	  brk = prev_ptr;
 	}
-
-        if(newsize <= GET_SIZE(HDRP(brk)))
-	  {
-	     return brk;
-        }
 	return NULL;
 }
 
 
+/*
+ * find_aligned_fit - like find_fit, for a block of asize bytes whose
+ *     payload must be moved up to a multiple of alignment
+ */
+static char *find_aligned_fit(size_t asize, size_t alignment)
+{
+  unsigned int off;
+  char *bp;
+
+  for(off = GET_HEAD(); off != NIL; off = GET(PREVP(ADDR(off))))
+  {
+    bp = ADDR(off);
+    if(ALIGN_UP(bp, alignment) - bp + asize <= GET_SIZE(HDRP(bp)))
+      return bp;
+  }
+  return NULL;
+}
+
 
 static void place(void *brk, size_t asize)
 {
@@ -243,6 +267,35 @@ static void place(void *brk, size_t asize)
 }
 
 
+/*
+ * mm_config - describe the policies this package was built with, as
+ * 	space-separated name=value pairs, for the driver's reports
+ */
+const char *mm_config(void)
+{
+  static char buf[128];
+
+  snprintf(buf, sizeof(buf), "CHUNKSIZE=%d EXPLICIT_LIST=%d "
+	   "MAP_THRESHOLD=%d FIT=first", CHUNKSIZE, EXPLICIT_LIST, 
+	   MAP_THRESHOLD);
+  return buf;
+}
+
+/*
+ * mm_free_bytes - total size of the blocks on the free list
+ */
+size_t mm_free_bytes(void)
+{
+  unsigned int off;
+  size_t bytes = 0;
+
+  mem_lock();
+  for(off = GET_HEAD(); off != NIL; off = GET(PREVP(ADDR(off))))
+    bytes += GET_SIZE(HDRP(ADDR(off)));
+  mem_unlock();
+  return bytes;
+}
+
 /*
  * mm_init - initialize the malloc package.
  * 	Allocating initial heap area, 64M at beginning 	
@@ -251,9 +304,11 @@ static void place(void *brk, size_t asize)
 int mm_init(void)
 {
   mem_reset_brk();
-  freeptr = NULL;  
+  heap_base = mem_heap_lo();
+  map_large = 1;
   allocptr = mem_sbrk(4 * WSIZE);
-  PUT(allocptr, 0);
+  // the padding word holds the head of the (empty) free list
+  SET_HEAD(NIL);
   // create prologue
   PUT(allocptr+WSIZE, PACK(OVERHEAD, 1));
   PUT(allocptr+DSIZE, PACK(OVERHEAD, 1));
@@ -265,6 +320,62 @@ int mm_init(void)
   return 0;
 }
 
+/*
+ * mm_open - attach to the heap image in the file at path, or create a
+ * 	new one there if the file holds no image yet
+ * 	return -1 if there is a problem, 0 otherwise
+ */
+int mm_open(const char *path)
+{
+  int attached = mem_open(path);
+
+  if(attached < 0)
+    return -1;
+  heap_base = mem_heap_lo();
+  // a fresh image needs a prologue, epilogue and first free block
+  if(!attached && mm_init() < 0)
+    return -1;
+  // a separate mapping would not be part of the image
+  map_large = 0;
+  return 0;
+}
+
+/*
+ * mm_open_shm - attach to the shared heap in the POSIX shared memory
+ * 	object name, or create it if it doesn't exist yet. Any number of
+ * 	processes can open the same heap; each may map it at a different
+ * 	address, so blocks are handed between them as heap offsets.
+ * 	return -1 if there is a problem, 0 otherwise
+ */
+int mm_open_shm(const char *name)
+{
+  int attached = mem_open_shm(name);
+  int rc = 0;
+
+  if(attached < 0)
+    return -1;
+  heap_base = mem_heap_lo();
+  // the creator holds the heap lock until the heap is set up
+  if(!attached)
+  {
+    rc = mm_init();
+    mem_unlock();
+  }
+  // nor would it be visible to the other processes
+  map_large = 0;
+  return rc;
+}
+
+/*
+ * mm_sync - flush the heap image opened by mm_open to its file
+ * 	every link in the heap is an offset, so there is nothing to fix up
+ * 	return -1 if there is a problem, 0 otherwise
+ */
+int mm_sync(void)
+{
+  return mem_sync();
+}
+
 /*
  * mm_exit - treat memory leak
  * 	free all unfreed memory blocks
@@ -277,20 +388,69 @@ int mm_exit(void)
 }
 
 /*
- * mm_malloc - Allocate a block by incrementing the brk pointer.
+ * map_block - give a large block a mapping of its own
+ */
+static void *map_block(size_t size)
+{
+  char *base;
+  size_t len = MAP_HDR + size;
+
+  if((base = mem_reserve(len)) == NULL)
+    return NULL;
+  if(mem_commit(base, len) < 0)
+  {
+    mem_release(base);
+    return NULL;
+  }
+  *(size_t *)base = len;
+  PUT(base + MAP_HDR - DSIZE, MAP_TAG(base));
+  PUT(base + MAP_HDR - WSIZE, PACK(0, 0x3));
+  return base + MAP_HDR;
+}
+
+/*
+ * remap_block - resize a mapped block by remapping its pages
+ */
+static void *remap_block(void *ptr, size_t size)
+{
+  char *base = (char *)ptr - MAP_HDR;
+  size_t len = MAP_HDR + size;
+
+  if((base = mem_remap(base, len)) == NULL)
+    return NULL;
+  *(size_t *)base = len;
+  PUT(base + MAP_HDR - DSIZE, MAP_TAG(base));
+  return base + MAP_HDR;
+}
+
+static void *heap_block(size_t newsize);
+
+/*
+ * malloc_block - Allocate a block by incrementing the brk pointer.
  *     Always allocate a block whose size is a multiple of the alignment.
  *     * maintain alignment
  *     * find the suitable place
  *     * place the block
  *     * extend the heap if not enough space
  */
-void *mm_malloc(size_t size)
+static void *malloc_block(size_t size)
 {
   assert( size > 0);
+  // large blocks are mapped on their own
+  if(size >= MAP_THRESHOLD && map_large)
+    return map_block(size);
   // maintain alignment
   // new size according to double word alignment
   // we add a DSIZE as header and footer is needed
-  size_t newsize = ALIGN(size + DSIZE );
+  return heap_block(ALIGN(size + DSIZE));
+}
+
+/*
+ * heap_block - place a block of newsize bytes (header and footer
+ *     included) in the heap
+ */
+static void *heap_block(size_t newsize)
+{
   size_t extendsize;
   // do i need to extend?
   if( (allocptr = find_fit(newsize)) != NULL) 
@@ -310,10 +470,15 @@ void *mm_malloc(size_t size)
 
 
 /*
- * mm_free - Freeing a block does nothing.
+ * free_block - put the block back on the free list and coalesce it
  */
-void mm_free(void *ptr)
+static void free_block(void *ptr)
 {
+  if(GET_MAPPED(HDRP(ptr)))
+  {
+    mem_release((char *)ptr - MAP_HDR);
+    return;
+  }
   size_t size = GET_SIZE(HDRP(ptr));
   PUT(HDRP(ptr), PACK(size, 0));
   PUT(FTRP(ptr), PACK(size, 0));  
@@ -322,7 +487,134 @@ void mm_free(void *ptr)
 }
 
 /*
- * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
+ * memalign_block - allocate a block whose payload is aligned to 
+ *     alignment, a power of two. A heap block is placed with room to 
+ *     spare, and the space before and after the aligned payload goes 
+ *     back to the free list.
+ */
+static void *memalign_block(size_t alignment, size_t size)
+{
+  char *bp, *p, *prev, *rest;
+  size_t asize, csize, gap;
+
+  if(alignment <= DSIZE)
+    return malloc_block(size);
+  // a mapped payload is MAP_HDR bytes into its page-aligned mapping
+  if(size >= MAP_THRESHOLD && map_large && alignment <= MAP_HDR)
+    return map_block(size);
+  asize = ALIGN(size + DSIZE);
+  if((bp = find_aligned_fit(asize, alignment)) != NULL)
+    place(bp, GET_SIZE(HDRP(bp)));
+  else if((bp = heap_block(asize + alignment - DSIZE)) == NULL)
+    return NULL;
+  csize = GET_SIZE(HDRP(bp));
+  p = ALIGN_UP(bp, alignment);
+  gap = p - bp;
+  if(gap == DSIZE)
+  {
+    // too small for a free block, so it pads the previous block, which
+    // is allocated (or the prologue) since free blocks are coalesced
+    prev = PREV_BLKP(bp);
+    PUT(HDRP(prev), GET(HDRP(prev)) + DSIZE);
+    PUT(FTRP(prev), GET(HDRP(prev)));
+    PUT(HDRP(p), PACK(csize - gap, 1));
+    PUT(FTRP(p), PACK(csize - gap, 1));
+    csize -= gap;
+  }
+  else if(gap > 0)
+  {
+    PUT(HDRP(bp), PACK(gap, 1));
+    PUT(FTRP(bp), PACK(gap, 1));
+    PUT(HDRP(p), PACK(csize - gap, 1));
+    PUT(FTRP(p), PACK(csize - gap, 1));
+    free_block(bp);
+    csize -= gap;
+  }
+  // split off the tail as place() would
+  if((csize - asize) > (DSIZE + 2* OVERHEAD))
+  {
+    PUT(HDRP(p), PACK(asize, 1));
+    PUT(FTRP(p), PACK(asize, 1));
+    rest = NEXT_BLKP(p);
+    PUT(HDRP(rest), PACK(csize - asize, 1));
+    PUT(FTRP(rest), PACK(csize - asize, 1));
+    free_block(rest);
+  }
+  return p;
+}
+
+/*
+ * The public entry points hold the heap lock (see mem_lock) around the
+ * list operations, so that processes or threads sharing a heap don't race.
+ */
+
+/*
+ * mm_malloc - allocate a block of at least size bytes
+ */
+void *mm_malloc(size_t size)
+{
+  void *ptr;
+
+  mem_lock();
+  ptr = malloc_block(size);
+  mem_unlock();
+  return ptr;
+}
+
+/*
+ * mm_free - free a block
+ */
+void mm_free(void *ptr)
+{
+  mem_lock();
+  free_block(ptr);
+  mem_unlock();
+}
+
+/*
+ * mm_memalign - allocate a block of at least size bytes whose address
+ *     is a multiple of alignment, a power of two
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+  void *ptr;
+
+  mem_lock();
+  ptr = memalign_block(alignment, size);
+  mem_unlock();
+  return ptr;
+}
+
+/*
+ * mm_usable_size - the bytes of payload the block at ptr really has,
+ *     which may be more than were asked for
+ */
+size_t mm_usable_size(void *ptr)
+{
+  if(GET_MAPPED(HDRP(ptr)))
+    return *(size_t *)((char *)ptr - MAP_HDR) - MAP_HDR;
+  return GET_SIZE(HDRP(ptr)) - DSIZE;
+}
+
+/*
+ * mm_mapped - is ptr the payload of a live mapped block? ptr must point
+ *     into readable memory; only its own page is read. No lookup, and
+ *     no lock: the block can only go away by being freed.
+ */
+int mm_mapped(void *ptr)
+{
+  char *base = (char *)ptr - MAP_HDR;
+
+  // a mapped payload is MAP_HDR bytes into its page-aligned mapping
+  if(((unsigned long)ptr & (mem_pagesize() - 1)) != MAP_HDR)
+    return 0;
+  return GET(base + MAP_HDR - DSIZE) == MAP_TAG(base) &&
+    GET(HDRP(ptr)) == PACK(0, 0x3);
+}
+
+/*
+ * mm_realloc - Implemented simply in terms of malloc_block and free_block
+ *     except that mapped blocks are resized by remapping their pages
  */
 void *mm_realloc(void *ptr, size_t size)
 {
@@ -330,17 +622,97 @@ void *mm_realloc(void *ptr, size_t size)
   void *newptr;
   size_t copySize;
 
-  newptr = mm_malloc(size);
+  mem_lock();
+  if (GET_MAPPED(HDRP(oldptr)))
+  {
+    newptr = remap_block(oldptr, size);
+    mem_unlock();
+    return newptr;
+  }
+  newptr = malloc_block(size);
   if (newptr == NULL)
+  {
+    mem_unlock();
     return NULL;
-  copySize = *(size_t *)((char *)oldptr - WSIZE);
+  }
+  copySize = GET_SIZE(HDRP(oldptr)) - DSIZE;
   if (size < copySize)
     copySize = size;    
   memcpy(newptr, oldptr, copySize);
-  mm_free(oldptr);
+  free_block(oldptr);
+  mem_unlock();
   return newptr;
 }
 
+/*
+ * Growable blocks live outside the heap, each in its own reserved 
+ * address range (see mem_reserve). The first SIZE_T_SIZE bytes of the
+ * range hold the largest size the block may grow to; pages are only
+ * committed as the block grows, so it never moves and is never copied.
+ */
+
+/*
+ * mm_galloc - allocate a growable block of size bytes that can later
+ *     grow to maxsize bytes in place
+ */
+void *mm_galloc(size_t size, size_t maxsize)
+{
+  char *base;
+
+  if(size > maxsize)
+    return NULL;
+  mem_lock();
+  if((base = mem_reserve(SIZE_T_SIZE + maxsize)) == NULL)
+  {
+    mem_unlock();
+    return NULL;
+  }
+  if(mem_commit(base, SIZE_T_SIZE + size) < 0)
+  {
+    mem_release(base);
+    mem_unlock();
+    return NULL;
+  }
+  *(size_t *)base = maxsize;
+  mem_unlock();
+  return base + SIZE_T_SIZE;
+}
+
+/*
+ * mm_grow - resize a growable block in place
+ *     return -1 if size is beyond the block's maxsize, 0 otherwise
+ */
+int mm_grow(void *ptr, size_t size)
+{
+  char *base = (char *)ptr - SIZE_T_SIZE;
+  int rc;
+
+  if(size > *(size_t *)base)
+    return -1;
+  mem_lock();
+  rc = mem_commit(base, SIZE_T_SIZE + size);
+  mem_unlock();
+  return rc;
+}
+
+/*
+ * mm_gfree - free a growable block and its address range
+ */
+void mm_gfree(void *ptr)
+{
+  mem_lock();
+  mem_release((char *)ptr - SIZE_T_SIZE);
+  mem_unlock();
+}
+
+#ifdef MM_PLUGIN
+/* The package as seen by mdriver -m, when built as mm.so */
+const mm_plugin_t mm_plugin = {
+  "mm.c", mm_init, mm_malloc, mm_free, mm_realloc, mm_config, mm_free_bytes,
+  NULL, mm_galloc, mm_grow, mm_gfree
+};
+#endif
+
 /*
  * mm_check - Does not currently check anything
  * 	is every block marked as free?
@@ -350,4 +722,3 @@ void *mm_realloc(void *ptr, size_t size)
  * 	do pointers in the heap block point to valid heap address?
  *	return nonzero if heap is consistent
  */
-
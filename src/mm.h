@@ -4,3 +4,39 @@ extern int mm_init (void);
 extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
+
+extern void *mm_galloc (size_t size, size_t maxsize);
+extern int mm_grow (void *ptr, size_t size);
+extern void mm_gfree (void *ptr);
+
+extern int mm_open (const char *path);
+extern int mm_open_shm (const char *name);
+extern int mm_sync (void);
+
+extern const char *mm_config (void);
+
+extern void *mm_memalign (size_t alignment, size_t size);
+extern size_t mm_usable_size (void *ptr);
+extern int mm_mapped (void *ptr);
+
+/* Optional: bytes on the free list, for the driver's -U samples */
+extern size_t mm_free_bytes (void) __attribute__((weak));
+
+/* 
+ * An allocator built as a shared object for mdriver -m exports one of
+ * these as mm_plugin (see MM_PLUGIN in mm.c). Hooks it doesn't have
+ * are NULL.
+ */
+typedef struct {
+    const char *name;
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    const char *(*config)(void);    /* optional: name=value;... policy */
+    size_t (*free_bytes)(void);     /* optional: bytes on the free list */
+    int (*check)(void);             /* optional: 0 if the heap is corrupt */
+    void *(*galloc)(size_t size, size_t maxsize); /* optional: growable */
+    int (*grow)(void *ptr, size_t size);          /*   blocks, all three */
+    void (*gfree)(void *ptr);                     /*   or none */
+} mm_plugin_t;
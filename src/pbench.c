@@ -0,0 +1,171 @@
+/*
+ * pbench.c - Benchmark for the file-backed persistent heap
+ *
+ * Builds a large heap image in a file by replaying a trace through
+ * mm_malloc/mm_realloc (frees are skipped, so the structures the trace
+ * builds stay live), then measures how long it takes to reattach to
+ * that image with mm_open instead. Growable blocks live outside the
+ * heap image, so they are replayed as ordinary blocks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "tracefile.h"
+
+#define DEFAULT_MBYTES 1024          /* default image size (MB) */
+#define DEFAULT_IMAGE  "pbench.img"  /* default image file */
+#define SLACK (64*(1<<20))           /* extra heap beyond the target size */
+
+/*
+ * now - Return the current time in seconds
+ */
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1E-6*tv.tv_usec;
+}
+
+/*
+ * rebuild - Replay the trace until the heap holds at least target bytes.
+ *     Returns the number of requests issued.
+ */
+static double rebuild(tracefile_t *tf, size_t target)
+{
+    char **blocks;
+    traceop_t *op;
+    double ops = 0;
+    int i;
+
+    if ((blocks = (char **)malloc(tf->num_ids * sizeof(char *))) == NULL) {
+	fprintf(stderr, "malloc failed in rebuild\n");
+	exit(1);
+    }
+    while (mem_heapsize() < target) {
+	for (i = 0; i < tf->num_ops && mem_heapsize() < target; i++) {
+	    op = &tf->ops[i];
+	    if (op->type == ALLOC || op->type == GALLOC)
+		blocks[op->index] = mm_malloc(op->size);
+	    else if (op->type == REALLOC || op->type == GROW)
+		blocks[op->index] = mm_realloc(blocks[op->index], op->size);
+	    else
+		continue;
+	    if (blocks[op->index] == NULL) { /* heap is full */
+		free(blocks);
+		return ops;
+	    }
+	    ops++;
+	}
+    }
+    free(blocks);
+    return ops;
+}
+
+/*
+ * touch - Read every page of the heap, so that the reattach numbers
+ *     can include faulting the image back in
+ */
+static void touch(void)
+{
+    volatile char *p;
+    char *hi = (char *)mem_heap_hi();
+    size_t pagesize = mem_pagesize();
+    char sum = 0;
+
+    for (p = (char *)mem_heap_lo(); p <= hi; p += pagesize)
+	sum += *p;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: pbench [-h] [-s <MB>] [-i <image>] -f <file>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-f <file>  Replay <file> to build the heap.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-i <image> Heap image file (default %s).\n",
+	    DEFAULT_IMAGE);
+    fprintf(stderr, "\t-s <MB>    Heap image size (default %d MB).\n",
+	    DEFAULT_MBYTES);
+}
+
+int main(int argc, char **argv)
+{
+    char c;
+    char *tracefile = NULL;
+    char *image = DEFAULT_IMAGE;
+    size_t target = (size_t)DEFAULT_MBYTES << 20;
+    tracefile_t *tf;
+    double start, build_secs, sync_secs, open_secs, touch_secs, ops;
+    size_t heapsize;
+
+    while ((c = getopt(argc, argv, "f:i:s:h")) != EOF) {
+	switch (c) {
+	case 'f': /* Trace to replay */
+	    tracefile = optarg;
+	    break;
+	case 'i': /* Heap image file */
+	    image = optarg;
+	    break;
+	case 's': /* Heap image size in MB */
+	    target = (size_t)atoi(optarg) << 20;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (tracefile == NULL) {
+	usage();
+	exit(1);
+    }
+    tf = tf_read(tracefile);
+
+    /* Rebuild: create a fresh image and replay the trace into it */
+    unlink(image);
+    mem_set_maxheap(target + SLACK);
+    start = now();
+    if (mm_open(image) < 0)
+	exit(1);
+    ops = rebuild(tf, target);
+    build_secs = now() - start;
+    start = now();
+    if (mm_sync() < 0)
+	exit(1);
+    sync_secs = now() - start;
+    heapsize = mem_heapsize();
+    mem_deinit();
+
+    /* Reattach: map the image again and fault it in */
+    start = now();
+    if (mm_open(image) < 0)
+	exit(1);
+    open_secs = now() - start;
+    start = now();
+    touch();
+    touch_secs = now() - start;
+    if (mem_heapsize() != heapsize) {
+	fprintf(stderr, "Reattached heap has %lu bytes, expected %lu\n",
+		(unsigned long)mem_heapsize(), (unsigned long)heapsize);
+	exit(1);
+    }
+    mm_free(mm_malloc(1)); /* the allocator is usable right away */
+    mem_deinit();
+
+    printf("Heap image %s: %.0f MB\n", image, heapsize/1048576.0);
+    printf("%-24s%12.6f secs (%.0f ops)\n", "rebuild by replay",
+	   build_secs, ops);
+    printf("%-24s%12.6f secs\n", "sync to file", sync_secs);
+    printf("%-24s%12.6f secs\n", "reattach", open_secs);
+    printf("%-24s%12.6f secs\n", "reattach + fault in",
+	   open_secs + touch_secs);
+    exit(0);
+}
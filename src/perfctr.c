@@ -0,0 +1,139 @@
+/*
+ * perfctr.c - Hardware event counters through perf_event_open(2)
+ *
+ * Each event gets a counter of its own rather than one group, so that
+ * the events the CPU does support are still counted when some aren't,
+ * and a multiplexed counter is scaled by time enabled / time running.
+ * Only user-mode events of the calling thread are counted, which works
+ * under the default perf_event_paranoid of 2.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+#define CACHE_MISS(cache, op) \
+    ((cache) | ((op) << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static struct {
+    char *name;
+    uint32_t type;
+    uint64_t config;
+} events[PC_NEVENTS] = {
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"l1d_misses", PERF_TYPE_HW_CACHE, 
+     CACHE_MISS(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ)},
+    {"llc_misses", PERF_TYPE_HW_CACHE,
+     CACHE_MISS(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ)},
+    {"dtlb_misses", PERF_TYPE_HW_CACHE,
+     CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ)},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int fds[PC_NEVENTS] = {-1, -1, -1, -1, -1, -1};
+
+/*
+ * PERF_EVENT_IOC_RESET zeroes a counter's value but not its times, so
+ * perfctr_start saves them and perfctr_stop scales by the differences
+ */
+static uint64_t enabled0[PC_NEVENTS], running0[PC_NEVENTS];
+
+/*
+ * perfctr_open - open a counter for each event we can
+ */
+int perfctr_open(void)
+{
+    struct perf_event_attr attr;
+    int i, n = 0;
+
+    for (i = 0; i < PC_NEVENTS; i++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | 
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fds[i] >= 0)
+	    n++;
+    }
+    return n;
+}
+
+/*
+ * perfctr_close - close the counters
+ */
+void perfctr_close(void)
+{
+    int i;
+
+    for (i = 0; i < PC_NEVENTS; i++) {
+	if (fds[i] >= 0)
+	    close(fds[i]);
+	fds[i] = -1;
+    }
+}
+
+/*
+ * perfctr_start - zero the counters, note their times, and start counting
+ */
+void perfctr_start(void)
+{
+    uint64_t buf[3]; /* value, time enabled, time running */
+    int i;
+
+    for (i = 0; i < PC_NEVENTS; i++) {
+	if (fds[i] >= 0) {
+	    ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+	    if (read(fds[i], buf, sizeof(buf)) != sizeof(buf))
+		buf[1] = buf[2] = 0;
+	    enabled0[i] = buf[1];
+	    running0[i] = buf[2];
+	    ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+    }
+}
+
+/*
+ * perfctr_stop - stop counting and read the counts
+ */
+void perfctr_stop(double *counts)
+{
+    uint64_t buf[3]; /* value, time enabled, time running */
+    uint64_t enabled, running;
+    int i;
+
+    for (i = 0; i < PC_NEVENTS; i++)
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    for (i = 0; i < PC_NEVENTS; i++) {
+	counts[i] = -1;
+	if (fds[i] < 0 || read(fds[i], buf, sizeof(buf)) != sizeof(buf))
+	    continue;
+	enabled = buf[1] - enabled0[i];
+	running = buf[2] - running0[i];
+	if (running == 0)        /* never got onto the PMU this run */
+	    continue;
+	counts[i] = (double)buf[0];
+	if (running < enabled)
+	    counts[i] *= (double)enabled / running;
+    }
+}
+
+/*
+ * perfctr_name - short name of event i
+ */
+char *perfctr_name(int i)
+{
+    return events[i].name;
+}
@@ -0,0 +1,39 @@
+/*
+ * perfctr.h - Hardware event counters for the calling thread, read
+ *     through perf_event_open(2)
+ */
+#ifndef __PERFCTR_H_
+#define __PERFCTR_H_
+
+/* The events, in the order perfctr_read reports them */
+#define PC_INSTRUCTIONS  0
+#define PC_CYCLES        1
+#define PC_L1D_MISSES    2
+#define PC_LLC_MISSES    3
+#define PC_DTLB_MISSES   4
+#define PC_BRANCH_MISSES 5
+#define PC_NEVENTS       6
+
+/* 
+ * Open a counter for each event, and return how many of them the
+ * kernel and the CPU support (0 under a strict perf_event_paranoid or
+ * in a VM without a virtual PMU)
+ */
+int perfctr_open(void);
+
+/* Close the counters */
+void perfctr_close(void);
+
+/* Zero the counters and start counting */
+void perfctr_start(void);
+
+/* 
+ * Stop counting and put each event's count in counts, scaled up if
+ * the kernel multiplexed it, or -1 if its counter couldn't be opened
+ */
+void perfctr_stop(double *counts);
+
+/* Short name of event i, e.g. "instructions" */
+char *perfctr_name(int i);
+
+#endif /* __PERFCTR_H_ */
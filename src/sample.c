@@ -0,0 +1,166 @@
+/*
+ * sample.c - Statistics over repeated timing samples
+ *
+ * Run times are skewed (a run can only be slowed down, by interrupts,
+ * page faults and other processes), so we compare medians and use tests
+ * that don't assume normally distributed samples.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sample.h"
+
+/*
+ * cmp_double - qsort comparison for doubles
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * sorted_copy - a sorted copy of the n values in x
+ */
+static double *sorted_copy(double *x, int n)
+{
+    double *y;
+
+    if ((y = (double *)malloc(n * sizeof(double))) == NULL) {
+	fprintf(stderr, "sample: out of memory\n");
+	exit(1);
+    }
+    memcpy(y, x, n * sizeof(double));
+    qsort(y, n, sizeof(double), cmp_double);
+    return y;
+}
+
+/*
+ * median_sorted - median of n sorted values
+ */
+static double median_sorted(double *y, int n)
+{
+    return (n % 2) ? y[n/2] : (y[n/2 - 1] + y[n/2]) / 2;
+}
+
+double sample_median(double *x, int n)
+{
+    double *y, m;
+
+    if (n <= 0)
+	return 0;
+    y = sorted_copy(x, n);
+    m = median_sorted(y, n);
+    free(y);
+    return m;
+}
+
+double sample_min(double *x, int n)
+{
+    double m;
+    int i;
+
+    if (n <= 0)
+	return 0;
+    for (m = x[0], i = 1; i < n; i++)
+	if (x[i] < m)
+	    m = x[i];
+    return m;
+}
+
+double sample_mad(double *x, int n)
+{
+    double *y, m;
+    int i;
+
+    if (n <= 0)
+	return 0;
+    y = sorted_copy(x, n);
+    m = median_sorted(y, n);
+    for (i = 0; i < n; i++)
+	y[i] = fabs(y[i] - m);
+    qsort(y, n, sizeof(double), cmp_double);
+    m = median_sorted(y, n);
+    free(y);
+    return m;
+}
+
+/*
+ * sample_mannwhitney - Rank a and b together (ties get the mean of
+ *     their ranks), compute U for a, and compare it against its mean 
+ *     and tie-corrected standard deviation under the null hypothesis
+ */
+double sample_mannwhitney(double *a, int na, double *b, int nb)
+{
+    int n = na + nb, i, j, k;
+    double *all, *y, rank, ra = 0, ties = 0, u, mu, sigma, z;
+
+    if (na == 0 || nb == 0)
+	return 1;
+    if ((all = (double *)malloc(n * sizeof(double))) == NULL) {
+	fprintf(stderr, "sample: out of memory\n");
+	exit(1);
+    }
+    memcpy(all, a, na * sizeof(double));
+    memcpy(all + na, b, nb * sizeof(double));
+    y = sorted_copy(all, n);
+
+    /* Sum the ranks of a's values, one run of equal values at a time */
+    for (i = 0; i < n; i = j) {
+	for (j = i; j < n && y[j] == y[i]; j++)
+	    ;
+	rank = (i + 1 + j) / 2.0;   /* mean of ranks i+1 .. j */
+	for (k = 0; k < na; k++)
+	    if (a[k] == y[i])
+		ra += rank;
+	ties += (double)(j - i) * (j - i) * (j - i) - (j - i);
+    }
+    free(all);
+    free(y);
+
+    u = ra - na * (na + 1) / 2.0;
+    mu = na * (double)nb / 2;
+    sigma = sqrt(na * (double)nb / 12 * ((n + 1) - ties / ((double)n * (n - 1))));
+    if (sigma == 0)
+	return 1;
+    z = (fabs(u - mu) - 0.5) / sigma;   /* with continuity correction */
+    if (z < 0)
+	z = 0;
+    return erfc(z / sqrt(2));
+}
+
+/*
+ * sample_ratio_ci - Percentile bootstrap: resample a and b with 
+ *     replacement, take the ratio of the medians, and return the 
+ *     middle conf fraction of those ratios
+ */
+void sample_ratio_ci(double *a, int na, double *b, int nb, double conf,
+		     int nboot, double *lo, double *hi)
+{
+    double *ra, *rb, *ratios;
+    unsigned int seed = 1;   /* fixed, so reports are reproducible */
+    int i, k;
+
+    if ((ra = (double *)malloc(na * sizeof(double))) == NULL ||
+	(rb = (double *)malloc(nb * sizeof(double))) == NULL ||
+	(ratios = (double *)malloc(nboot * sizeof(double))) == NULL) {
+	fprintf(stderr, "sample: out of memory\n");
+	exit(1);
+    }
+    for (i = 0; i < nboot; i++) {
+	for (k = 0; k < na; k++)
+	    ra[k] = a[rand_r(&seed) % na];
+	for (k = 0; k < nb; k++)
+	    rb[k] = b[rand_r(&seed) % nb];
+	ratios[i] = sample_median(ra, na) / sample_median(rb, nb);
+    }
+    qsort(ratios, nboot, sizeof(double), cmp_double);
+    *lo = ratios[(int)((1 - conf) / 2 * (nboot - 1))];
+    *hi = ratios[(int)((1 + conf) / 2 * (nboot - 1))];
+    free(ra);
+    free(rb);
+    free(ratios);
+}
@@ -0,0 +1,34 @@
+/*
+ * sample.h - Statistics over repeated timing samples, for comparing a
+ *     run of the driver against a baseline run
+ */
+#ifndef __SAMPLE_H_
+#define __SAMPLE_H_
+
+/* Median of the n values in x (x is left unchanged) */
+double sample_median(double *x, int n);
+
+/* Smallest of the n values in x */
+double sample_min(double *x, int n);
+
+/* 
+ * Median absolute deviation from the median of the n values in x, a
+ * spread that a few slow outliers can't inflate the way they do the
+ * standard deviation
+ */
+double sample_mad(double *x, int n);
+
+/* 
+ * Two-sided p-value of the Mann-Whitney U test that samples a and b
+ * come from the same distribution (normal approximation, with ties)
+ */
+double sample_mannwhitney(double *a, int na, double *b, int nb);
+
+/* 
+ * Bootstrap confidence interval, at level conf (e.g. 0.95), for the 
+ * ratio median(a) / median(b), from nboot resamples
+ */
+void sample_ratio_ci(double *a, int na, double *b, int nb, double conf,
+		     int nboot, double *lo, double *hi);
+
+#endif /* __SAMPLE_H_ */
@@ -0,0 +1,268 @@
+/*
+ * shbench.c - Multi-process benchmark for the shared-memory heap
+ *
+ * Creates one heap in a POSIX shared memory object (mm_open_shm) and
+ * forks several children that each map it at their own address and
+ * replay the traces on it concurrently. Before exiting, every child
+ * hands one filled block to the parent as a heap offset; the parent
+ * checks its contents and frees it, without any copying.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "tracefile.h"
+#include "config.h"
+
+#define MAXLINE       1024             /* max string size */
+#define DEFAULT_PROCS 4                /* default number of children */
+#define DEFAULT_SHM   "/mm-shbench"    /* default shm object name */
+#define HANDOFF_BYTES 4096             /* size of each handed-off block */
+
+/* What each child reports to the parent through the pipe */
+typedef struct {
+    int child;             /* child number */
+    double ops;            /* requests issued by the child */
+    double secs;           /* time the child spent replaying */
+    unsigned long offset;  /* heap offset of the block it hands off */
+} result_t;
+
+/* The filenames of the default tracefiles */
+static char *default_tracefiles[] = {
+    DEFAULT_TRACEFILES, NULL
+};
+
+/*
+ * now - Return the current time in seconds
+ */
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + 1E-6*tv.tv_usec;
+}
+
+/*
+ * replay - Run one trace against the shared heap. Returns the number
+ *     of requests issued, or -1 if the allocator failed.
+ */
+static double replay(tracefile_t *tf)
+{
+    char **blocks;
+    traceop_t *op;
+    int i;
+
+    if ((blocks = (char **)malloc(tf->num_ids * sizeof(char *))) == NULL)
+	return -1;
+    for (i = 0; i < tf->num_ops; i++) {
+	op = &tf->ops[i];
+	switch (op->type) {
+	case ALLOC:
+	    blocks[op->index] = mm_malloc(op->size);
+	    break;
+	case REALLOC:
+	    blocks[op->index] = mm_realloc(blocks[op->index], op->size);
+	    break;
+	case FREE:
+	    mm_free(blocks[op->index]);
+	    continue;
+	case GALLOC: /* growable blocks are private to each child */
+	    blocks[op->index] = mm_galloc(op->size, GROW_RESERVE);
+	    break;
+	case GROW:
+	    if (mm_grow(blocks[op->index], op->size) < 0)
+		blocks[op->index] = NULL;
+	    break;
+	case GFREE:
+	    mm_gfree(blocks[op->index]);
+	    continue;
+	}
+	if (blocks[op->index] == NULL) {
+	    free(blocks);
+	    return -1;
+	}
+    }
+    free(blocks);
+    return tf->num_ops;
+}
+
+/*
+ * child - Map the shared heap, replay every trace on it, hand one
+ *     block back to the parent and exit
+ */
+static void child(int n, char *shm, tracefile_t **tfs, int ntraces, int fd)
+{
+    result_t res;
+    double start, ops;
+    char *p;
+    int i;
+
+    /* Drop the mapping inherited from the parent and map our own */
+    mem_deinit();
+    if (mm_open_shm(shm) < 0)
+	exit(1);
+
+    res.child = n;
+    res.ops = 0;
+    start = now();
+    for (i = 0; i < ntraces; i++) {
+	if ((ops = replay(tfs[i])) < 0) {
+	    fprintf(stderr, "child %d: allocator failed on trace %d\n", n, i);
+	    exit(1);
+	}
+	res.ops += ops;
+    }
+    res.secs = now() - start;
+
+    if ((p = mm_malloc(HANDOFF_BYTES)) == NULL)
+	exit(1);
+    memset(p, n & 0xFF, HANDOFF_BYTES);
+    res.offset = p - (char *)mem_heap_lo();
+    if (write(fd, &res, sizeof(res)) != sizeof(res))
+	exit(1);
+    exit(0);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: shbench [-h] [-n <procs>] [-s <name>] "
+	    "[-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-n <procs> Number of child processes (default %d).\n",
+	    DEFAULT_PROCS);
+    fprintf(stderr, "\t-s <name>  Shared memory object (default %s).\n",
+	    DEFAULT_SHM);
+    fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+}
+
+int main(int argc, char **argv)
+{
+    char c;
+    char tracedir[MAXLINE] = TRACEDIR;
+    char path[MAXLINE];
+    char **tracefiles = default_tracefiles;
+    char *onefile[2] = {NULL, NULL};
+    char *shm = DEFAULT_SHM;
+    int nprocs = DEFAULT_PROCS;
+    int ntraces, i, j, status, errors = 0;
+    int fds[2];
+    tracefile_t **tfs;
+    result_t res;
+    double start, secs, ops = 0;
+    char *p;
+
+    while ((c = getopt(argc, argv, "f:n:s:t:h")) != EOF) {
+	switch (c) {
+	case 'f': /* Use one specific trace file only */
+	    onefile[0] = optarg;
+	    tracefiles = onefile;
+	    strcpy(tracedir, "./");
+	    break;
+	case 'n': /* Number of children */
+	    nprocs = atoi(optarg);
+	    break;
+	case 's': /* Name of the shared memory object */
+	    shm = optarg;
+	    break;
+	case 't': /* Directory where the traces are located */
+	    if (tracefiles == onefile)
+		break;
+	    strcpy(tracedir, optarg);
+	    if (tracedir[strlen(tracedir)-1] != '/')
+		strcat(tracedir, "/");
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (nprocs < 1) {
+	usage();
+	exit(1);
+    }
+
+    /* Read the traces once; the children share them copy-on-write */
+    for (ntraces = 0; tracefiles[ntraces]; ntraces++)
+	;
+    if ((tfs = (tracefile_t **)malloc(ntraces * sizeof(tracefile_t *)))
+	== NULL) {
+	fprintf(stderr, "malloc failed in main\n");
+	exit(1);
+    }
+    for (i = 0; i < ntraces; i++) {
+	strcpy(path, tracedir);
+	strcat(path, tracefiles[i]);
+	tfs[i] = tf_read(path);
+    }
+
+    /* Create a fresh shared heap with room for every child */
+    shm_unlink(shm);
+    mem_set_maxheap((size_t)nprocs * MAX_HEAP);
+    if (mm_open_shm(shm) < 0)
+	exit(1);
+    if (pipe(fds) < 0) {
+	perror("pipe");
+	exit(1);
+    }
+
+    start = now();
+    for (i = 0; i < nprocs; i++) {
+	pid_t pid = fork();
+	if (pid < 0) {
+	    perror("fork");
+	    exit(1);
+	}
+	if (pid == 0) {
+	    close(fds[0]);
+	    child(i, shm, tfs, ntraces, fds[1]);
+	}
+    }
+    close(fds[1]);
+
+    /* Collect the results and the handed-off blocks */
+    printf("%5s%10s%10s%8s\n", "child", "ops", "secs", "Kops");
+    while (read(fds[0], &res, sizeof(res)) == sizeof(res)) {
+	printf("%5d%10.0f%10.6f%8.0f\n", res.child, res.ops, res.secs,
+	       (res.ops/1e3)/res.secs);
+	ops += res.ops;
+	p = (char *)mem_heap_lo() + res.offset;
+	for (j = 0; j < HANDOFF_BYTES; j++) {
+	    if (p[j] != (char)(res.child & 0xFF)) {
+		printf("ERROR: block handed off by child %d is corrupt\n",
+		       res.child);
+		errors++;
+		break;
+	    }
+	}
+	mm_free(p);
+    }
+    for (i = 0; i < nprocs; i++) {
+	wait(&status);
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	    errors++;
+    }
+    secs = now() - start;
+
+    printf("Total %d procs: %.0f ops in %.6f secs = %.0f Kops, "
+	   "heap %.1f MB\n", nprocs, ops, secs, (ops/1e3)/secs,
+	   mem_heapsize()/1048576.0);
+    mem_deinit();
+    shm_unlink(shm);
+    if (errors) {
+	printf("Terminated with %d errors\n", errors);
+	exit(1);
+    }
+    exit(0);
+}
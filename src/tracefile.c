@@ -0,0 +1,533 @@
+/*
+ * tracefile.c - Routines for reading malloc lab trace files
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "tracefile.h"
+
+#define TF_CHECKSUM_INIT 2166136261U   /* FNV-1a offset basis */
+
+/* 
+ * tf_error - Report an error in the trace file at path and exit
+ */
+static void tf_error(const char *path, const char *msg)
+{
+    fprintf(stderr, "%s: %s\n", path, msg);
+    exit(1);
+}
+
+/*
+ * tf_checksum_more - continue an FNV-1a checksum over n more op records
+ */
+static uint32_t tf_checksum_more(uint32_t sum, const traceop_t *ops, int n)
+{
+    const uint32_t *w = (const uint32_t *)ops;
+    size_t i, nwords = (size_t)n * (sizeof(traceop_t) / sizeof(uint32_t));
+
+    for (i = 0; i < nwords; i++)
+	sum = (sum ^ w[i]) * 16777619U;
+    return sum;
+}
+
+/*
+ * tf_checksum - FNV-1a over the 32-bit words of n op records
+ */
+uint32_t tf_checksum(const traceop_t *ops, int n)
+{
+    return tf_checksum_more(TF_CHECKSUM_INIT, ops, n);
+}
+
+/*
+ * tf_check_op - Make sure a decoded request can be replayed safely
+ */
+static void tf_check_op(const char *path, int num_ids, traceop_t *op)
+{
+    if (op->type < ALLOC || op->type > GFREE)
+	tf_error(path, "bogus request type");
+    if (op->index < 0 || op->index >= num_ids)
+	tf_error(path, "request id out of range");
+}
+
+/*
+ * tf_scan_op - Parse the next request line of a text trace
+ */
+static void tf_scan_op(const char *path, FILE *fp, int num_ids, 
+		       traceop_t *op)
+{
+    char type[2];
+
+    if (fscanf(fp, "%1s", type) != 1)
+	tf_error(path, "trace ends before num_ops requests");
+    op->size = 0;
+    switch (type[0]) {
+    case 'a':
+    case 'g':
+	op->type = (type[0] == 'g') ? GALLOC : ALLOC;
+	if (fscanf(fp, "%d %d", &op->index, &op->size) != 2)
+	    tf_error(path, type[0] == 'g' ? "'g' expects 2 arguments" :
+		     "'a' expects 2 arguments");
+	break;
+    case 'r':
+	op->type = REALLOC;
+	if (fscanf(fp, "%d %d", &op->index, &op->size) != 2)
+	    tf_error(path, "'r' expects 2 arguments");
+	break;
+    case 'f':
+	op->type = FREE;
+	if (fscanf(fp, "%d", &op->index) != 1)
+	    tf_error(path, "'f' expects 1 argument");
+	break;
+    default:
+	tf_error(path, "bogus request type");
+    }
+    tf_check_op(path, num_ids, op);
+}
+
+/*
+ * tf_resolve - Turn reallocs and frees of a growable block into GROW 
+ *     and GFREE. Requests on a growable block stay growable until it 
+ *     is freed; growable holds the ids for which that is the case.
+ */
+static void tf_resolve(idmap_t *growable, traceop_t *op)
+{
+    switch (op->type) {
+    case ALLOC:
+	idmap_del(growable, op->index);
+	break;
+    case GALLOC:
+	idmap_put(growable, op->index);
+	break;
+    case REALLOC:
+	if (idmap_get(growable, op->index))
+	    op->type = GROW;
+	break;
+    case FREE:
+	if (idmap_get(growable, op->index))
+	    op->type = GFREE;
+	idmap_del(growable, op->index);
+	break;
+    default:
+	break;
+    }
+}
+
+/*
+ * tf_read_bin - Map the binary trace open on fd. The requests are used
+ *     in place, so the only pass over them checks the checksum and 
+ *     that every record is in range.
+ */
+static void tf_read_bin(const char *path, int fd, tracefile_t *tf)
+{
+    struct stat st;
+    tf_header_t *hdr;
+    int i;
+
+    if (fstat(fd, &st) < 0)
+	tf_error(path, strerror(errno));
+    if ((size_t)st.st_size < sizeof(tf_header_t))
+	tf_error(path, "truncated binary trace header");
+    tf->maplen = st.st_size;
+    tf->map = mmap(NULL, tf->maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (tf->map == MAP_FAILED)
+	tf_error(path, strerror(errno));
+
+    hdr = (tf_header_t *)tf->map;
+    if (hdr->version != TF_VERSION)
+	tf_error(path, "unsupported binary trace version");
+    if (hdr->num_ops < 0 || hdr->num_ids < 0 ||
+	tf->maplen != sizeof(tf_header_t) + 
+	(size_t)hdr->num_ops * sizeof(traceop_t))
+	tf_error(path, "binary trace size does not match its header");
+    tf->sugg_heapsize = hdr->sugg_heapsize;
+    tf->num_ids = hdr->num_ids;
+    tf->num_ops = hdr->num_ops;
+    tf->weight = hdr->weight;
+    tf->ops = (traceop_t *)(hdr + 1);
+
+    if (tf_checksum(tf->ops, tf->num_ops) != hdr->checksum)
+	tf_error(path, "bad binary trace checksum");
+    for (i = 0; i < tf->num_ops; i++)
+	tf_check_op(path, tf->num_ids, &tf->ops[i]);
+}
+
+/*
+ * tf_read - Read the trace file at path and store it in memory. Binary
+ *     traces are mapped rather than read.
+ */
+tracefile_t *tf_read(const char *path)
+{
+    FILE *fp;
+    tracefile_t *tf;
+    idmap_t *growable;
+    uint32_t magic;
+    int i;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	tf_error(path, strerror(errno));
+    if ((tf = (tracefile_t *)malloc(sizeof(tracefile_t))) == NULL)
+	tf_error(path, "malloc failed in tf_read");
+    tf->map = NULL;
+    tf->maplen = 0;
+
+    /* Binary traces start with the magic number, text ones with digits */
+    if (fread(&magic, sizeof(magic), 1, fp) == 1 && magic == TF_MAGIC) {
+	tf_read_bin(path, fileno(fp), tf);
+	fclose(fp);
+	return tf;
+    }
+    rewind(fp);
+
+    /* Read the 4-line header */
+    if (fscanf(fp, "%d %d %d %d", &tf->sugg_heapsize, &tf->num_ids,
+	       &tf->num_ops, &tf->weight) != 4)
+	tf_error(path, "bad trace header");
+    if ((tf->ops = (traceop_t *)malloc(tf->num_ops * sizeof(traceop_t))) 
+	== NULL)
+	tf_error(path, "malloc failed in tf_read");
+    growable = idmap_new();
+
+    /* Read every request line */
+    for (i = 0; i < tf->num_ops; i++) {
+	tf_scan_op(path, fp, tf->num_ids, &tf->ops[i]);
+	tf_resolve(growable, &tf->ops[i]);
+    }
+    idmap_free(growable);
+    fclose(fp);
+    return tf;
+}
+
+/*
+ * tf_write_bin - Write tf to path as a binary trace
+ */
+int tf_write_bin(tracefile_t *tf, const char *path)
+{
+    FILE *fp;
+    tf_header_t hdr;
+
+    hdr.magic = TF_MAGIC;
+    hdr.version = TF_VERSION;
+    hdr.sugg_heapsize = tf->sugg_heapsize;
+    hdr.num_ids = tf->num_ids;
+    hdr.num_ops = tf->num_ops;
+    hdr.weight = tf->weight;
+    hdr.checksum = tf_checksum(tf->ops, tf->num_ops);
+    hdr.reserved = 0;
+
+    if ((fp = fopen(path, "w")) == NULL) {
+	fprintf(stderr, "%s: %s\n", path, strerror(errno));
+	return -1;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	fwrite(tf->ops, sizeof(traceop_t), tf->num_ops, fp) != 
+	(size_t)tf->num_ops) {
+	fprintf(stderr, "%s: %s\n", path, strerror(errno));
+	fclose(fp);
+	return -1;
+    }
+    if (fclose(fp) != 0) {
+	fprintf(stderr, "%s: %s\n", path, strerror(errno));
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * tf_write_header - Write the header of w at the start of its file.
+ *     Text counts are padded to a fixed width so that tf_finish can
+ *     overwrite the blank header with the final one in place.
+ */
+static int tf_write_header(tfwriter_t *w, int sugg_heapsize, int weight)
+{
+    tf_header_t hdr;
+
+    if (fseek(w->fp, 0, SEEK_SET) < 0)
+	return -1;
+    if (!w->binary)
+	return fprintf(w->fp, "%10d\n%10d\n%10d\n%10d\n", sugg_heapsize, 
+		       w->num_ids, w->num_ops, weight) < 0 ? -1 : 0;
+
+    hdr.magic = TF_MAGIC;
+    hdr.version = TF_VERSION;
+    hdr.sugg_heapsize = sugg_heapsize;
+    hdr.num_ids = w->num_ids;
+    hdr.num_ops = w->num_ops;
+    hdr.weight = weight;
+    hdr.checksum = w->checksum;
+    hdr.reserved = 0;
+    return fwrite(&hdr, sizeof(hdr), 1, w->fp) == 1 ? 0 : -1;
+}
+
+/*
+ * tf_create - Create a trace file at path for writing with tf_put
+ */
+tfwriter_t *tf_create(const char *path, int binary)
+{
+    tfwriter_t *w;
+
+    if ((w = (tfwriter_t *)calloc(1, sizeof(tfwriter_t))) == NULL ||
+	(w->path = strdup(path)) == NULL) {
+	fprintf(stderr, "%s: malloc failed in tf_create\n", path);
+	free(w);
+	return NULL;
+    }
+    w->binary = binary;
+    w->checksum = TF_CHECKSUM_INIT;
+    if (binary)
+	w->growable = idmap_new();
+    if ((w->fp = fopen(path, "w")) == NULL || 
+	tf_write_header(w, 0, 0) < 0) {
+	fprintf(stderr, "%s: %s\n", path, strerror(errno));
+	if (w->fp)
+	    fclose(w->fp);
+	free(w->path);
+	free(w);
+	return NULL;
+    }
+    return w;
+}
+
+/*
+ * tf_put - Append one request to the trace. Requests use the .rep 
+ *     types (ALLOC, GALLOC, REALLOC, FREE); binary traces get reallocs
+ *     and frees of growable blocks resolved as they are written.
+ */
+int tf_put(tfwriter_t *w, int type, int index, int size)
+{
+    traceop_t op;
+    static const char code[] = "afr";
+    int ok;
+
+    if (index >= w->num_ids)
+	w->num_ids = index + 1;
+    w->num_ops++;
+    if (!w->binary) {
+	if (type == GALLOC)
+	    ok = fprintf(w->fp, "g %d %d\n", index, size);
+	else if (type == FREE || type == GFREE)
+	    ok = fprintf(w->fp, "f %d\n", index);
+	else
+	    ok = fprintf(w->fp, "%c %d %d\n", 
+			 code[type == GROW ? REALLOC : type], index, size);
+	if (ok < 0) {
+	    fprintf(stderr, "%s: %s\n", w->path, strerror(errno));
+	    return -1;
+	}
+	return 0;
+    }
+
+    op.type = type;
+    op.index = index;
+    op.size = (type == FREE || type == GFREE) ? 0 : size;
+    tf_resolve(w->growable, &op);
+    w->checksum = tf_checksum_more(w->checksum, &op, 1);
+    if (fwrite(&op, sizeof(op), 1, w->fp) != 1) {
+	fprintf(stderr, "%s: %s\n", w->path, strerror(errno));
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * tf_finish - Rewrite the header with the final counts and close the
+ *     trace
+ */
+int tf_finish(tfwriter_t *w, int sugg_heapsize, int weight)
+{
+    int rc = 0;
+
+    if (tf_write_header(w, sugg_heapsize, weight) < 0) {
+	fprintf(stderr, "%s: %s\n", w->path, strerror(errno));
+	rc = -1;
+    }
+    if (fclose(w->fp) != 0 && rc == 0) {
+	fprintf(stderr, "%s: %s\n", w->path, strerror(errno));
+	rc = -1;
+    }
+    if (w->growable)
+	idmap_free(w->growable);
+    free(w->path);
+    free(w);
+    return rc;
+}
+
+/*
+ * tf_free - Free a trace record and its request array, or unmap the
+ *     binary trace the requests live in
+ */
+void tf_free(tracefile_t *tf)
+{
+    if (tf->map != NULL)
+	munmap(tf->map, tf->maplen);
+    else
+	free(tf->ops);
+    free(tf);
+}
+
+/*
+ * tf_fill - Decode up to TF_CHUNK more requests of the stream into buf.
+ *     Returns how many, 0 at the end of the trace.
+ */
+static int tf_fill(tfstream_t *s, traceop_t *buf)
+{
+    int i, n = s->num_ops - s->decoded;
+
+    if (n > TF_CHUNK)
+	n = TF_CHUNK;
+    if (s->binary) {
+	if (fread(buf, sizeof(traceop_t), n, s->fp) != (size_t)n)
+	    tf_error(s->path, "binary trace ends before num_ops requests");
+	s->checksum = tf_checksum_more(s->checksum, buf, n);
+	for (i = 0; i < n; i++)
+	    tf_check_op(s->path, s->num_ids, &buf[i]);
+	if (s->decoded + n == s->num_ops && s->checksum != s->expected)
+	    tf_error(s->path, "bad binary trace checksum");
+    }
+    else {
+	for (i = 0; i < n; i++) {
+	    tf_scan_op(s->path, s->fp, s->num_ids, &buf[i]);
+	    tf_resolve(s->growable, &buf[i]);
+	}
+    }
+    s->decoded += n;
+    return n;
+}
+
+/*
+ * tf_reader - Body of the reader thread. It fills the two buffers in
+ *     turn, each as soon as the replay hands it back, so decoding the
+ *     next chunk overlaps with replaying the current one.
+ */
+static void *tf_reader(void *arg)
+{
+    tfstream_t *s = (tfstream_t *)arg;
+    int b = 0, n, stop;
+
+    do {
+	pthread_mutex_lock(&s->lock);
+	while (s->count[b] >= 0 && !s->stop)
+	    pthread_cond_wait(&s->cond, &s->lock);
+	stop = s->stop;
+	pthread_mutex_unlock(&s->lock);
+	if (stop)
+	    break;
+
+	n = tf_fill(s, s->buf[b]);
+
+	pthread_mutex_lock(&s->lock);
+	s->count[b] = n;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	b ^= 1;
+    } while (n > 0);
+    return NULL;
+}
+
+/*
+ * tf_open - Open the trace file at path for streaming and start its
+ *     reader thread
+ */
+tfstream_t *tf_open(const char *path)
+{
+    tfstream_t *s;
+    tf_header_t hdr;
+
+    if ((s = (tfstream_t *)calloc(1, sizeof(tfstream_t))) == NULL)
+	tf_error(path, "malloc failed in tf_open");
+    if ((s->path = strdup(path)) == NULL)
+	tf_error(path, "malloc failed in tf_open");
+    if ((s->fp = fopen(path, "r")) == NULL)
+	tf_error(path, strerror(errno));
+
+    /* Read the header of either format */
+    if (fread(&hdr, sizeof(hdr), 1, s->fp) == 1 && hdr.magic == TF_MAGIC) {
+	if (hdr.version != TF_VERSION)
+	    tf_error(path, "unsupported binary trace version");
+	s->binary = 1;
+	s->sugg_heapsize = hdr.sugg_heapsize;
+	s->num_ids = hdr.num_ids;
+	s->num_ops = hdr.num_ops;
+	s->weight = hdr.weight;
+	s->checksum = TF_CHECKSUM_INIT;
+	s->expected = hdr.checksum;
+    }
+    else {
+	rewind(s->fp);
+	if (fscanf(s->fp, "%d %d %d %d", &s->sugg_heapsize, &s->num_ids,
+		   &s->num_ops, &s->weight) != 4)
+	    tf_error(path, "bad trace header");
+	s->growable = idmap_new();
+    }
+    if (s->num_ops < 0 || s->num_ids < 0)
+	tf_error(path, "bad trace header");
+
+    if ((s->buf[0] = (traceop_t *)malloc(TF_CHUNK * sizeof(traceop_t))) 
+	== NULL ||
+	(s->buf[1] = (traceop_t *)malloc(TF_CHUNK * sizeof(traceop_t))) 
+	== NULL)
+	tf_error(path, "malloc failed in tf_open");
+    s->count[0] = s->count[1] = -1;
+    s->cur = -1;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    if ((errno = pthread_create(&s->reader, NULL, tf_reader, s)) != 0)
+	tf_error(path, strerror(errno));
+    return s;
+}
+
+/*
+ * tf_next - Hand the buffer from the last call back to the reader and
+ *     point *ops at the next chunk of requests. Returns the number of
+ *     requests in it, 0 at the end of the trace.
+ */
+int tf_next(tfstream_t *s, traceop_t **ops)
+{
+    int n;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->cur >= 0) {
+	if (s->count[s->cur] == 0) { /* already at the end */
+	    pthread_mutex_unlock(&s->lock);
+	    return 0;
+	}
+	s->count[s->cur] = -1;
+	pthread_cond_broadcast(&s->cond);
+	s->cur ^= 1;
+    }
+    else
+	s->cur = 0;
+    while (s->count[s->cur] < 0)
+	pthread_cond_wait(&s->cond, &s->lock);
+    n = s->count[s->cur];
+    pthread_mutex_unlock(&s->lock);
+    *ops = s->buf[s->cur];
+    return n;
+}
+
+/*
+ * tf_close - Stop the reader thread and free the stream
+ */
+void tf_close(tfstream_t *s)
+{
+    pthread_mutex_lock(&s->lock);
+    s->stop = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->reader, NULL);
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    fclose(s->fp);
+    if (s->growable)
+	idmap_free(s->growable);
+    free(s->buf[0]);
+    free(s->buf[1]);
+    free(s->path);
+    free(s);
+}
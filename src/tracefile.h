@@ -0,0 +1,137 @@
+/*
+ * tracefile.h - Routines for reading malloc lab trace files, for the 
+ *     tools that replay traces. Traces come either as .rep text (see 
+ *     traces/README.md) or in the binary format below, which rep2bin
+ *     converts them to; tf_read tells the two apart by the magic number.
+ *     Traces too large to hold in memory can be streamed with tf_open,
+ *     and written a request at a time with tf_create.
+ */
+#ifndef __TRACEFILE_H_
+#define __TRACEFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "idmap.h"
+
+/* Trace operations (allocator requests) */
+enum {ALLOC, FREE, REALLOC, GALLOC, GROW, GFREE};
+
+/* 
+ * Characterizes a single trace operation (allocator request). GALLOC
+ * allocates a growable block; tf_read turns later reallocs and frees
+ * of that id into GROW and GFREE. This is also the record layout of
+ * binary traces, so every field is a fixed 32 bits.
+ */
+typedef struct {
+    int32_t type;                     /* request */
+    int32_t index;                    /* index for free() to use later */
+    int32_t size;                     /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Holds the header and the requests of one trace file */
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+    traceop_t *ops;      /* array of requests */
+    void *map;           /* mapping of a binary trace, NULL for text */
+    size_t maplen;       /* bytes in that mapping */
+} tracefile_t;
+
+/* 
+ * A binary trace is this header followed by num_ops traceop_t records
+ * in host byte order, with GROW and GFREE already resolved. The
+ * checksum is tf_checksum of the records.
+ */
+#define TF_MAGIC   0x4254534dU   /* "MSTB" in a little-endian file */
+#define TF_VERSION 1
+
+typedef struct {
+    uint32_t magic;          /* TF_MAGIC */
+    uint32_t version;        /* TF_VERSION */
+    int32_t sugg_heapsize;   /* as in the .rep header */
+    int32_t num_ids;
+    int32_t num_ops;
+    int32_t weight;
+    uint32_t checksum;       /* checksum of the op records */
+    uint32_t reserved;       /* zero; keeps the header 8-byte aligned */
+} tf_header_t;
+
+/* 
+ * A trace being streamed: a reader thread decodes it TF_CHUNK requests
+ * at a time into two buffers, which tf_next hands out in turn. Only the
+ * header fields are meant to be read outside of tracefile.c.
+ */
+#define TF_CHUNK 65536
+
+typedef struct {
+    int sugg_heapsize;   /* suggested heap size (unused) */
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight for this trace (unused) */
+
+    char *path;          /* for error messages */
+    FILE *fp;            /* the trace file */
+    int binary;          /* set if it is a binary trace */
+    uint32_t checksum;   /* binary: checksum of the records read so far... */
+    uint32_t expected;   /* ... and the one the header promises */
+    idmap_t *growable;   /* text: ids that name growable blocks */
+    int decoded;         /* requests decoded so far */
+    traceop_t *buf[2];   /* the two chunk buffers */
+    int count[2];        /* requests in each buffer, -1 while it is empty */
+    int cur;             /* buffer the replay holds, -1 before the first */
+    int stop;            /* set by tf_close to stop the reader */
+    pthread_t reader;    /* the reader thread */
+    pthread_mutex_t lock;
+    pthread_cond_t cond; /* signalled when a buffer fills or empties */
+} tfstream_t;
+
+/* 
+ * A trace being written a request at a time. The header goes in first
+ * with blank counts, which tf_finish fills in once they are known.
+ */
+typedef struct {
+    char *path;          /* for error messages */
+    FILE *fp;            /* the trace file */
+    int binary;          /* set to write a binary trace */
+    int num_ids;         /* one more than the largest id so far */
+    int num_ops;         /* requests written so far */
+    uint32_t checksum;   /* binary: checksum of those requests */
+    idmap_t *growable;   /* binary: ids that name growable blocks */
+} tfwriter_t;
+
+/* Read the trace file at path; exits with a message on error */
+tracefile_t *tf_read(const char *path);
+
+/* Write tf to path in the binary format; returns -1 on error */
+int tf_write_bin(tracefile_t *tf, const char *path);
+
+/* Checksum of n op records */
+uint32_t tf_checksum(const traceop_t *ops, int n);
+
+/* Create a text (or, if binary is set, binary) trace file at path */
+tfwriter_t *tf_create(const char *path, int binary);
+
+/* Append a request to w; returns -1 on error */
+int tf_put(tfwriter_t *w, int type, int index, int size);
+
+/* Fill in the header of w, close it and free w; returns -1 on error */
+int tf_finish(tfwriter_t *w, int sugg_heapsize, int weight);
+
+/* Free a trace returned by tf_read */
+void tf_free(tracefile_t *tf);
+
+/* Open the trace file at path for streaming; exits on error */
+tfstream_t *tf_open(const char *path);
+
+/* Point *ops at the next chunk of requests; returns 0 at the end */
+int tf_next(tfstream_t *s, traceop_t **ops);
+
+/* Stop streaming and free s */
+void tf_close(tfstream_t *s);
+
+#endif /* __TRACEFILE_H_ */
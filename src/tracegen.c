@@ -0,0 +1,445 @@
+/*
+ * tracegen.c - Generate synthetic malloc lab traces from a model
+ *
+ * A trace is a sequence of phases. Each phase issues a fixed number of
+ * requests, drawing the size of every new block and its lifetime (in
+ * requests) from distributions of its own. A block is freed when its
+ * lifetime runs out, so by Little's law about (mean lifetime) blocks
+ * are live at once. A fraction of the blocks grow instead: when their
+ * lifetime runs out they are reallocated to a multiple of their size
+ * and get a new lifetime, a given number of times before being freed.
+ * Blocks still live at the end of the last phase are freed, so traces
+ * are balanced.
+ *
+ * Pending deaths sit in a binary heap and freed ids are reused, so the
+ * generator runs in O(log live) time per request and memory linear in
+ * the peak number of live blocks; 100M-request traces with millions of
+ * live blocks take well under a minute to generate.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "tracefile.h"
+#include "config.h"
+
+#define MAXPHASES  64     /* phases in one trace */
+#define MAXSIZE    (1<<30) /* largest block a request may ask for */
+
+/*
+ * A distribution of positive integers:
+ *     uniform:MIN:MAX      uniform over [MIN, MAX]
+ *     exp:MEAN             exponential with mean MEAN
+ *     pow:ALPHA:MIN:MAX    power law (bounded Pareto) with exponent ALPHA
+ *     bimodal:A:B:P        A, or B with probability P
+ *     hist:FILE            empirical: FILE has "value count" lines
+ */
+typedef struct {
+    enum {UNIFORM, EXP, POW, BIMODAL, HIST} kind;
+    double a, b, c;       /* parameters, in the order above */
+    int nbins;            /* hist: number of values... */
+    int *values;          /* ... the values ... */
+    double *cum;          /* ... and their cumulative probabilities */
+} dist_t;
+
+/* One phase of the trace */
+typedef struct {
+    long long ops;        /* requests to issue (-n) */
+    dist_t size;          /* sizes of new blocks (-s) */
+    dist_t life;          /* lifetimes, in requests (-l) */
+    double grow_p;        /* probability a block grows (-r) ... */
+    int grow_n;           /* ... how many times ... */
+    double grow_f;        /* ... and by what factor */
+    int growable;         /* set to allocate growing blocks with 'g' (-g) */
+} phase_t;
+
+/* A pending death (or growth) in the event heap */
+typedef struct {
+    long long when;       /* request number at which it happens */
+    int id;
+} event_t;
+
+/* Global state */
+static unsigned long long rng_state;   /* xorshift64* state (-S) */
+static event_t *heap;                  /* events, a binary min-heap */
+static int heap_len, heap_max;
+static int *sizes;                     /* current size of each id */
+static int *grows;                     /* growths each id has left */
+static char *growable;                 /* set if the id is a 'g' block */
+static int *free_ids;                  /* freed ids, reused first */
+static int nfree;
+static int num_ids;                    /* ids handed out so far */
+static long long live_bytes, peak_bytes;
+static int live, peak_live;
+static long long nops;                 /* requests written so far */
+
+/* Function prototypes */
+static double rng_unit(void);
+static void parse_dist(char *spec, dist_t *d);
+static int draw(dist_t *d);
+static void heap_push(long long when, int id);
+static event_t heap_pop(void);
+static int new_id(void);
+static void put(tfwriter_t *w, int type, int index, int size);
+static void usage(void);
+static void gen_error(char *msg);
+
+/*
+ * rng_unit - A uniform random number in (0, 1), from xorshift64*
+ */
+static double rng_unit(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 2685821657736338717ULL >> 11) + 0.5) /
+	9007199254740992.0;
+}
+
+/*
+ * parse_dist - Parse a distribution spec (see dist_t) into d
+ */
+static void parse_dist(char *spec, dist_t *d)
+{
+    FILE *fp;
+    int value, max = 0;
+    double count, total = 0;
+    char *file;
+
+    memset(d, 0, sizeof(*d));
+    if (sscanf(spec, "uniform:%lf:%lf", &d->a, &d->b) == 2)
+	d->kind = UNIFORM;
+    else if (sscanf(spec, "exp:%lf", &d->a) == 1)
+	d->kind = EXP;
+    else if (sscanf(spec, "pow:%lf:%lf:%lf", &d->a, &d->b, &d->c) == 3)
+	d->kind = POW;
+    else if (sscanf(spec, "bimodal:%lf:%lf:%lf", &d->a, &d->b, &d->c) == 3)
+	d->kind = BIMODAL;
+    else if (strncmp(spec, "hist:", 5) == 0) {
+	d->kind = HIST;
+	file = spec + 5;
+	if ((fp = fopen(file, "r")) == NULL)
+	    gen_error(file);
+	while (fscanf(fp, "%d %lf", &value, &count) == 2) {
+	    if (d->nbins == max) {
+		max = max ? 2*max : 64;
+		if ((d->values = realloc(d->values, max * sizeof(int))) == NULL ||
+		    (d->cum = realloc(d->cum, max * sizeof(double))) == NULL)
+		    gen_error("realloc failed in parse_dist");
+	    }
+	    total += count;
+	    d->values[d->nbins] = value;
+	    d->cum[d->nbins++] = total;
+	}
+	fclose(fp);
+	if (d->nbins == 0 || total <= 0) {
+	    fprintf(stderr, "tracegen: %s has no \"value count\" lines\n", file);
+	    exit(1);
+	}
+	for (value = 0; value < d->nbins; value++)
+	    d->cum[value] /= total;
+    }
+    else {
+	fprintf(stderr, "tracegen: bad distribution \"%s\"\n", spec);
+	usage();
+	exit(1);
+    }
+    if ((d->kind == UNIFORM && (d->a < 1 || d->b < d->a)) ||
+	(d->kind == EXP && d->a <= 0) ||
+	(d->kind == POW && (d->a <= 0 || d->b < 1 || d->c < d->b)) ||
+	(d->kind == BIMODAL && (d->a < 1 || d->b < 1 || d->c < 0 || d->c > 1))) {
+	fprintf(stderr, "tracegen: bad parameters in \"%s\"\n", spec);
+	exit(1);
+    }
+}
+
+/*
+ * draw - Draw a value, at least 1, from the distribution d
+ */
+static int draw(dist_t *d)
+{
+    double u = rng_unit(), x = 0, la, ha;
+    int lo, hi, mid;
+
+    switch (d->kind) {
+    case UNIFORM:
+	x = d->a + u * (d->b - d->a + 1);
+	break;
+    case EXP:
+	x = 1 - d->a * log(u);
+	break;
+    case POW:
+	/* Invert the CDF of the Pareto distribution cut to [MIN, MAX] */
+	la = pow(d->b, d->a);
+	ha = pow(d->c, d->a);
+	x = pow(-(u * ha - u * la - ha) / (ha * la), -1 / d->a);
+	break;
+    case BIMODAL:
+	x = (u < d->c) ? d->b : d->a;
+	break;
+    case HIST:
+	for (lo = 0, hi = d->nbins - 1; lo < hi; ) {
+	    mid = (lo + hi) / 2;
+	    if (d->cum[mid] < u)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	x = d->values[lo];
+	break;
+    }
+    if (x < 1)
+	return 1;
+    return (x > MAXSIZE) ? MAXSIZE : (int)x;
+}
+
+/*
+ * heap_push - Schedule an event for id at request number when
+ */
+static void heap_push(long long when, int id)
+{
+    int i, parent;
+
+    if (heap_len == heap_max) {
+	heap_max = heap_max ? 2*heap_max : 1024;
+	if ((heap = realloc(heap, heap_max * sizeof(event_t))) == NULL)
+	    gen_error("realloc failed in heap_push");
+    }
+    for (i = heap_len++; i > 0; i = parent) {
+	parent = (i - 1) / 2;
+	if (heap[parent].when <= when)
+	    break;
+	heap[i] = heap[parent];
+    }
+    heap[i].when = when;
+    heap[i].id = id;
+}
+
+/*
+ * heap_pop - Remove and return the earliest event
+ */
+static event_t heap_pop(void)
+{
+    event_t top = heap[0], last = heap[--heap_len];
+    int i, child;
+
+    for (i = 0; (child = 2*i + 1) < heap_len; i = child) {
+	if (child + 1 < heap_len && heap[child+1].when < heap[child].when)
+	    child++;
+	if (last.when <= heap[child].when)
+	    break;
+	heap[i] = heap[child];
+    }
+    heap[i] = last;
+    return top;
+}
+
+/*
+ * new_id - A free id, reusing freed ones so that num_ids stays close
+ *     to the peak number of live blocks
+ */
+static int new_id(void)
+{
+    static int max_ids = 0;
+
+    if (nfree > 0)
+	return free_ids[--nfree];
+    if (num_ids == max_ids) {
+	max_ids = max_ids ? 2*max_ids : 1024;
+	if ((sizes = realloc(sizes, max_ids * sizeof(int))) == NULL ||
+	    (grows = realloc(grows, max_ids * sizeof(int))) == NULL ||
+	    (growable = realloc(growable, max_ids)) == NULL ||
+	    (free_ids = realloc(free_ids, max_ids * sizeof(int))) == NULL)
+	    gen_error("realloc failed in new_id");
+    }
+    return num_ids++;
+}
+
+/*
+ * put - Write a request and keep track of the live blocks and bytes
+ */
+static void put(tfwriter_t *w, int type, int index, int size)
+{
+    switch (type) {
+    case ALLOC:
+    case GALLOC:
+	live++;
+	live_bytes += size;
+	break;
+    case REALLOC:
+	live_bytes += size - sizes[index];
+	break;
+    case FREE:
+	live--;
+	live_bytes -= sizes[index];
+	free_ids[nfree++] = index;
+	break;
+    }
+    sizes[index] = size;
+    if (live > peak_live)
+	peak_live = live;
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+    if (++nops > INT_MAX) {
+	fprintf(stderr, "tracegen: a trace holds at most %d requests\n", 
+		INT_MAX);
+	exit(1);
+    }
+    if (tf_put(w, type, index, size) < 0)
+	exit(1);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tracegen [-hb] [-S <seed>] <phase> [-P <phase>]... <out>\n");
+    fprintf(stderr, "where each <phase> is [-n <ops>] [-s <dist>] [-l <dist>] [-r <p>:<n>:<f>] [-g]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b          Write a binary trace instead of .rep text.\n");
+    fprintf(stderr, "\t-h          Print this message.\n");
+    fprintf(stderr, "\t-S <seed>   Seed the random numbers (default 1).\n");
+    fprintf(stderr, "\t-P          End a phase; the next one starts with its settings.\n");
+    fprintf(stderr, "\t-n <ops>    Requests in the phase (default 100000).\n");
+    fprintf(stderr, "\t-s <dist>   Block sizes (default pow:1.5:8:4096).\n");
+    fprintf(stderr, "\t-l <dist>   Block lifetimes, in requests (default exp:1000).\n");
+    fprintf(stderr, "\t-r <p>:<n>:<f> Grow a fraction <p> of the blocks <n> times\n");
+    fprintf(stderr, "\t            by a factor <f> with realloc (default 0:0:1),\n");
+    fprintf(stderr, "\t            up to %d MB (%d MB for 'g' blocks).\n",
+	    MAXSIZE >> 20, GROW_RESERVE >> 20);
+    fprintf(stderr, "\t-g          Allocate the growing blocks that stay within\n");
+    fprintf(stderr, "\t            GROW_RESERVE with 'g' requests.\n");
+    fprintf(stderr, "Distributions: uniform:MIN:MAX exp:MEAN pow:ALPHA:MIN:MAX\n");
+    fprintf(stderr, "\t       bimodal:A:B:P (B with probability P) hist:FILE\n");
+    fprintf(stderr, "\t       (FILE has a \"value count\" line per value)\n");
+}
+
+/*
+ * gen_error - Report a failed library call and exit
+ */
+static void gen_error(char *msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    char c;
+    int binary = 0, nphases = 1, p, id;
+    phase_t phases[MAXPHASES], *ph;
+    long long now = 0, i;
+    tfwriter_t *w;
+    event_t ev;
+    double size;
+
+    /* The defaults of the first phase */
+    rng_state = 1;
+    ph = &phases[0];
+    memset(ph, 0, sizeof(*ph));
+    ph->ops = 100000;
+    parse_dist("pow:1.5:8:4096", &ph->size);
+    parse_dist("exp:1000", &ph->life);
+    ph->grow_f = 1;
+
+    while ((c = getopt(argc, argv, "hbS:Pn:s:l:r:g")) != EOF) {
+	switch (c) {
+	case 'b':
+	    binary = 1;
+	    break;
+	case 'S':
+	    rng_state = strtoull(optarg, NULL, 0) | 1;
+	    break;
+	case 'P':
+	    if (nphases == MAXPHASES) {
+		fprintf(stderr, "tracegen: at most %d phases\n", MAXPHASES);
+		exit(1);
+	    }
+	    phases[nphases] = *ph;
+	    ph = &phases[nphases++];
+	    break;
+	case 'n':
+	    ph->ops = atoll(optarg);
+	    break;
+	case 's':
+	    parse_dist(optarg, &ph->size);
+	    break;
+	case 'l':
+	    parse_dist(optarg, &ph->life);
+	    break;
+	case 'r':
+	    if (sscanf(optarg, "%lf:%d:%lf", &ph->grow_p, &ph->grow_n,
+		       &ph->grow_f) != 3 || ph->grow_p < 0 || ph->grow_p > 1 ||
+		ph->grow_n < 0 || ph->grow_f <= 0) {
+		usage();
+		exit(1);
+	    }
+	    break;
+	case 'g':
+	    ph->growable = 1;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (argc - optind != 1) {
+	usage();
+	exit(1);
+    }
+    if ((w = tf_create(argv[optind], binary)) == NULL)
+	exit(1);
+
+    for (p = 0; p < nphases; p++) {
+	ph = &phases[p];
+	for (i = 0; i < ph->ops; i++, now++) {
+	    /* A block whose time has come grows or is freed... */
+	    if (heap_len > 0 && heap[0].when <= now) {
+		ev = heap_pop();
+		if (grows[ev.id] > 0) {
+		    grows[ev.id]--;
+		    size = sizes[ev.id] * ph->grow_f;
+		    if (size > (growable[ev.id] ? GROW_RESERVE : MAXSIZE))
+			size = growable[ev.id] ? GROW_RESERVE : MAXSIZE;
+		    put(w, REALLOC, ev.id, size < 1 ? 1 : (int)size);
+		    heap_push(now + draw(&ph->life), ev.id);
+		}
+		else
+		    put(w, FREE, ev.id, 0);
+		continue;
+	    }
+
+	    /* 
+	     * ... otherwise a new one is allocated. A growing block is a
+	     * 'g' block with -g, unless it would outgrow the GROW_RESERVE
+	     * bytes the driver reserves for one; growth in later phases
+	     * is capped there.
+	     */
+	    id = new_id();
+	    grows[id] = (rng_unit() < ph->grow_p) ? ph->grow_n : 0;
+	    size = draw(&ph->size);
+	    growable[id] = grows[id] && ph->growable &&
+		size * pow(ph->grow_f > 1 ? ph->grow_f : 1, grows[id]) <= 
+		GROW_RESERVE;
+	    put(w, growable[id] ? GALLOC : ALLOC, id, (int)size);
+	    heap_push(now + draw(&ph->life), id);
+	}
+    }
+
+    /* Free whatever is still live, in the order it would have died */
+    while (heap_len > 0)
+	put(w, FREE, heap_pop().id, 0);
+
+    if (tf_finish(w, peak_bytes > MAXSIZE ? MAXSIZE : (int)peak_bytes, 1) < 0)
+	exit(1);
+    printf("%s: %d ids, %lld ops, peak %d blocks and %lld bytes live\n",
+	   argv[optind], num_ids, nops, peak_live, peak_bytes);
+    exit(0);
+}
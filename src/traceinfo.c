@@ -0,0 +1,381 @@
+/*
+ * traceinfo.c - Profile the workload in a trace, to see what an
+ *     allocator will be up against before tuning it
+ *
+ * Reports the request mix, the size histogram, the lifetimes of blocks
+ * (in requests), live blocks and bytes over time and at their peak,
+ * how much reallocs grow their blocks, how allocs and frees interleave,
+ * and a lower bound on fragmentation: the best utilization any
+ * allocator that aligns blocks to ALIGNMENT bytes could reach.
+ *
+ * The trace is streamed with tf_open, and the live blocks are kept in
+ * an idmap, so memory grows with the number of live blocks rather than
+ * with the length of the trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tracefile.h"
+#include "config.h"
+
+#define NBUCKETS  33     /* power-of-two buckets, enough for 32-bit values */
+#define ALIGN(n)  (((n) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
+#define TAGS      8      /* header and footer words of a boundary-tag block */
+
+/* Realloc growth ratios (new size / old size) are binned by these */
+static double ratio_limits[] = {0.5, 0.999999, 1.000001, 1.25, 1.5, 2, 4};
+static char *ratio_names[] = {"< 0.5", "0.5 - 1", "1", "1 - 1.25",
+			      "1.25 - 1.5", "1.5 - 2", "2 - 4", "> 4"};
+#define NRATIOS (sizeof(ratio_limits) / sizeof(double) + 1)
+
+/* Running totals of one measure of the live blocks */
+typedef struct {
+    long long now;       /* current total */
+    long long peak;      /* largest total so far */
+    long long peak_op;   /* request at which it was reached */
+} live_t;
+
+/* Function prototypes */
+static int bucket(long long x);
+static void live_add(live_t *l, long long delta, long long op);
+static void print_hist(char *title, char *unit, long long *hist,
+		       long long total);
+static void count_value(idmap_t *m, int value);
+static void write_values(idmap_t *m, char *path);
+static void usage(void);
+
+/*
+ * bucket - Index of the power-of-two bucket [2^(k-1), 2^k) that x is
+ *     in; bucket 0 holds 0
+ */
+static int bucket(long long x)
+{
+    int k = 0;
+
+    while (x > 0 && k < NBUCKETS - 1) {
+	x >>= 1;
+	k++;
+    }
+    return k;
+}
+
+/*
+ * live_add - Add delta to a live total and track its peak
+ */
+static void live_add(live_t *l, long long delta, long long op)
+{
+    l->now += delta;
+    if (l->now > l->peak) {
+	l->peak = l->now;
+	l->peak_op = op;
+    }
+}
+
+/*
+ * print_hist - Print the non-empty buckets of a power-of-two histogram
+ */
+static void print_hist(char *title, char *unit, long long *hist,
+		       long long total)
+{
+    int k;
+    long long cum = 0;
+
+    printf("\n%s\n", title);
+    printf("%24s%12s%8s%8s\n", unit, "count", "%", "cum %");
+    for (k = 0; k < NBUCKETS; k++) {
+	if (hist[k] == 0)
+	    continue;
+	cum += hist[k];
+	if (k == 0)
+	    printf("%24s", "0");
+	else
+	    printf("%11lld - %10lld", 1LL << (k-1), (1LL << k) - 1);
+	printf("%12lld%8.2f%8.2f\n", hist[k], 100.0 * hist[k] / total,
+	       100.0 * cum / total);
+    }
+}
+
+/*
+ * count_value - Count one more occurrence of value in m, whose entries
+ *     hold a count in their size field
+ */
+static void count_value(idmap_t *m, int value)
+{
+    idmap_entry_t *e = idmap_get(m, value);
+
+    if (e == NULL) {
+	e = idmap_put(m, value);
+	e->ptr = NULL;
+	e->size = 0;
+    }
+    e->size++;
+}
+
+/*
+ * cmp_entry - qsort comparison of idmap entries by id
+ */
+static int cmp_entry(const void *a, const void *b)
+{
+    int x = ((const idmap_entry_t *)a)->id, y = ((const idmap_entry_t *)b)->id;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * write_values - Write the values counted in m to path as "value count"
+ *     lines, in the form tracegen's hist: distributions read
+ */
+static void write_values(idmap_t *m, char *path)
+{
+    idmap_entry_t *v;
+    size_t i, n = 0;
+    FILE *fp;
+
+    if ((v = (idmap_entry_t *)malloc(m->count * sizeof(idmap_entry_t)))
+	== NULL) {
+	fprintf(stderr, "traceinfo: out of memory\n");
+	exit(1);
+    }
+    for (i = 0; i <= m->mask; i++)
+	if (m->table[i].id != IDMAP_EMPTY)
+	    v[n++] = m->table[i];
+    qsort(v, n, sizeof(idmap_entry_t), cmp_entry);
+    if ((fp = fopen(path, "w")) == NULL) {
+	perror(path);
+	exit(1);
+    }
+    for (i = 0; i < n; i++)
+	fprintf(fp, "%d %lu\n", v[i].id, (unsigned long)v[i].size);
+    fclose(fp);
+    free(v);
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: traceinfo [-h] [-i <n>] [-s <file>] [-l <file>] <trace>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-i <n>     Print the live blocks and bytes every <n> requests\n");
+    fprintf(stderr, "\t           (default: 20 times over the trace).\n");
+    fprintf(stderr, "\t-s <file>  Write the exact size histogram to <file>.\n");
+    fprintf(stderr, "\t-l <file>  Write the exact lifetime histogram to <file>.\n");
+}
+
+int main(int argc, char **argv)
+{
+    char c;
+    char *size_file = NULL, *life_file = NULL;
+    long long interval = 0, op = 0, lifetime;
+    tfstream_t *s;
+    traceop_t *ops;
+    idmap_t *live, *sizes, *lifetimes;
+    idmap_entry_t *e;
+    int n, i, size, type, last_alloc = -1, run_type = -1;
+
+    /* What we count */
+    long long nreq[GFREE+1] = {0};          /* requests of each type */
+    long long size_hist[NBUCKETS] = {0};    /* sizes of allocs */
+    long long life_hist[NBUCKETS] = {0};    /* lifetimes of freed blocks */
+    long long ratio_hist[NRATIOS] = {0};    /* realloc growth ratios */
+    long long alloc_runs = 0, free_runs = 0, run = 0, max_alloc_run = 0;
+    long long max_free_run = 0, lifo_frees = 0, bogus = 0, k;
+    double size_sum = 0, life_sum = 0;
+    live_t blocks = {0, 0, 0};     /* live blocks */
+    live_t bytes = {0, 0, 0};      /* live payload bytes */
+    live_t aligned = {0, 0, 0};    /* ... rounded up to ALIGNMENT */
+    live_t tagged = {0, 0, 0};     /* ... plus boundary tags */
+
+    while ((c = getopt(argc, argv, "hi:s:l:")) != EOF) {
+	switch (c) {
+	case 'i':
+	    interval = atoll(optarg);
+	    break;
+	case 's':
+	    size_file = optarg;
+	    break;
+	case 'l':
+	    life_file = optarg;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (argc - optind != 1) {
+	usage();
+	exit(1);
+    }
+
+    s = tf_open(argv[optind]);
+    if (interval <= 0)
+	interval = (s->num_ops >= 20) ? s->num_ops / 20 : 1;
+    live = idmap_new();
+    sizes = idmap_new();
+    lifetimes = idmap_new();
+
+    printf("%s: %d ids, %d requests\n", argv[optind], s->num_ids, s->num_ops);
+    printf("\nLive blocks over time\n");
+    printf("%12s%12s%14s\n", "request", "blocks", "bytes");
+
+    /*
+     * One pass over the trace. The live map holds the size of each
+     * live block, and in its ptr field the request that allocated it.
+     */
+    while ((n = tf_next(s, &ops)) > 0) {
+	for (i = 0; i < n; i++, op++) {
+	    type = ops[i].type;
+	    size = ops[i].size;
+	    nreq[type]++;
+
+	    /* Runs of allocs and of frees; reallocs don't break runs */
+	    if (type != REALLOC && type != GROW) {
+		k = (type == FREE || type == GFREE);
+		if (k != run_type) {
+		    if (run_type == 0 && run > max_alloc_run)
+			max_alloc_run = run;
+		    if (run_type == 1 && run > max_free_run)
+			max_free_run = run;
+		    if (k)
+			free_runs++;
+		    else
+			alloc_runs++;
+		    run_type = k;
+		    run = 0;
+		}
+		run++;
+	    }
+
+	    switch (type) {
+	    case ALLOC:
+	    case GALLOC:
+		e = idmap_put(live, ops[i].index);
+		e->ptr = (char *)(size_t)op;
+		e->size = size;
+		size_hist[bucket(size)]++;
+		size_sum += size;
+		count_value(sizes, size);
+		live_add(&blocks, 1, op);
+		live_add(&bytes, size, op);
+		live_add(&aligned, ALIGN(size), op);
+		live_add(&tagged, ALIGN(size + TAGS), op);
+		last_alloc = ops[i].index;
+		break;
+
+	    case REALLOC:
+	    case GROW:
+		if ((e = idmap_get(live, ops[i].index)) == NULL) {
+		    bogus++;
+		    break;
+		}
+		for (k = 0; k < NRATIOS - 1 &&
+			 (double)size / (e->size ? e->size : 1) > ratio_limits[k];
+		     k++)
+		    ;
+		ratio_hist[k]++;
+		live_add(&bytes, (long long)size - e->size, op);
+		live_add(&aligned, (long long)ALIGN(size) - ALIGN(e->size), op);
+		live_add(&tagged, (long long)ALIGN(size + TAGS) -
+			 ALIGN(e->size + TAGS), op);
+		e->size = size;
+		break;
+
+	    case FREE:
+	    case GFREE:
+		if ((e = idmap_get(live, ops[i].index)) == NULL) {
+		    bogus++;
+		    break;
+		}
+		lifetime = op - (long long)(size_t)e->ptr;
+		life_hist[bucket(lifetime)]++;
+		life_sum += lifetime;
+		if (life_file)
+		    count_value(lifetimes, (int)lifetime);
+		if (ops[i].index == last_alloc)
+		    lifo_frees++;
+		last_alloc = -1;
+		live_add(&blocks, -1, op);
+		live_add(&bytes, -(long long)e->size, op);
+		live_add(&aligned, -(long long)ALIGN(e->size), op);
+		live_add(&tagged, -(long long)ALIGN(e->size + TAGS), op);
+		idmap_del(live, ops[i].index);
+		break;
+	    }
+
+	    if ((op + 1) % interval == 0)
+		printf("%12lld%12lld%14lld\n", op + 1, blocks.now, bytes.now);
+	}
+    }
+    if (run_type == 0 && run > max_alloc_run)
+	max_alloc_run = run;
+    if (run_type == 1 && run > max_free_run)
+	max_free_run = run;
+    tf_close(s);
+
+    printf("\nRequests\n");
+    printf("%12s%12s%12s%12s%12s%12s\n",
+	   "alloc", "realloc", "free", "galloc", "grow", "gfree");
+    printf("%12lld%12lld%12lld%12lld%12lld%12lld\n", nreq[ALLOC],
+	   nreq[REALLOC], nreq[FREE], nreq[GALLOC], nreq[GROW], nreq[GFREE]);
+    if (bogus)
+	printf("%lld reallocs or frees of ids that weren't live\n", bogus);
+
+    k = nreq[ALLOC] + nreq[GALLOC];
+    if (k > 0) {
+	print_hist("Allocation sizes", "bytes", size_hist, k);
+	printf("mean %.1f bytes\n", size_sum / k);
+    }
+
+    k = nreq[FREE] + nreq[GFREE] - bogus;
+    if (k > 0) {
+	print_hist("Lifetimes of freed blocks", "requests", life_hist, k);
+	printf("mean %.1f requests; %lld blocks are never freed\n",
+	       life_sum / k, blocks.now);
+    }
+
+    k = nreq[REALLOC] + nreq[GROW];
+    if (k > 0) {
+	printf("\nRealloc growth (new size / old size)\n");
+	printf("%24s%12s%8s\n", "ratio", "count", "%");
+	for (i = 0; i < (int)NRATIOS; i++)
+	    if (ratio_hist[i])
+		printf("%24s%12lld%8.2f\n", ratio_names[i], ratio_hist[i],
+		       100.0 * ratio_hist[i] / k);
+    }
+
+    printf("\nInterleaving\n");
+    printf("%lld runs of allocs (mean %.1f, longest %lld), "
+	   "%lld runs of frees (mean %.1f, longest %lld)\n",
+	   alloc_runs, alloc_runs ? (double)(nreq[ALLOC] + nreq[GALLOC]) /
+	   alloc_runs : 0, max_alloc_run, free_runs, free_runs ?
+	   (double)(nreq[FREE] + nreq[GFREE]) / free_runs : 0, max_free_run);
+    k = nreq[FREE] + nreq[GFREE];
+    printf("%.1f%% of frees free the block allocated just before\n",
+	   k ? 100.0 * lifo_frees / k : 0);
+
+    printf("\nPeak live\n");
+    printf("%lld blocks at request %lld\n", blocks.peak, blocks.peak_op);
+    printf("%lld payload bytes at request %lld\n", bytes.peak, bytes.peak_op);
+    printf("%lld bytes aligned to %d, %lld with %d-byte boundary tags\n",
+	   aligned.peak, ALIGNMENT, tagged.peak, TAGS);
+    if (aligned.peak > 0)
+	printf("Best possible utilization: %.1f%% with %d-byte alignment, "
+	       "%.1f%% with boundary tags\n", 100.0 * bytes.peak / aligned.peak,
+	       ALIGNMENT, 100.0 * bytes.peak / tagged.peak);
+
+    if (size_file)
+	write_values(sizes, size_file);
+    if (life_file)
+	write_values(lifetimes, life_file);
+    idmap_free(live);
+    idmap_free(sizes);
+    idmap_free(lifetimes);
+    exit(0);
+}